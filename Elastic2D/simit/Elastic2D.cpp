@@ -1,9 +1,18 @@
 #include "Elastic2D.h"
+#include "FloatField.h"
+#include "MeshCache.h"
+#include "MeshGenerator.h"
+#include "SimitSource.h"
+#include <algorithm>
 #include <cmath>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <stdexcept>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <typeinfo>
 
 #define str(s) #s
@@ -12,6 +21,31 @@
 using namespace std;
 
 const int spr_k = 0;//1e4;
+const ElasticParams defaultParams = { 1e4, 1e3, 1e-4 };	// alpha, beta, h
+const double defaultMassPerUnitArea = 10.0;
+const double gridStep = 0.125;	// of generated meshes, the edge of square.obj
+
+// floats per HyperEdge in Elastic2D.sim and Elastic2DSlim.sim, without
+// alpha and beta, which only a sweep keeps per triangle
+static const int hyperEdgeFloats = 67;
+static const int slimHyperEdgeFloats = 8;
+
+// adaptive step control
+const double adaptEnergyTol  = 1e-4;	// relative energy error per step
+const double adaptStrainStep = 1e-2;	// largest strain increment per step
+const double adaptCfl        = 0.5;	// fraction of the CFL step
+const double adaptGrow       = 2.0;
+const double adaptShrink     = 0.5;
+const double adaptMinH       = 1e-9;
+const int    adaptBenchLimit = 100;	// bench attempts per fixed step
+
+const int sleepInterval = 10;	// steps between settle() checks
+
+// multigrid stepper
+const double coarseCells     = 4.0;	// decimation cell, in mean rest edges
+const double solveTol        = 1e-8;	// relative residual, as in implicit
+const int solveMaxIterations = 5000;
+const int newtonIterations   = 5;
 const int pinList[] = {1,2};
 
 float angleX = 0.f;
@@ -66,7 +100,38 @@ static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 /* ********************* */
 
 
-Elastic2D::Elastic2D() : points(), hyperedges(points,points,points) {
+// Per-step scratch of the full HyperEdge, which the slim program keeps in
+// registers.
+static void addScratch(simit::Set& hyperedges, Precision precision) {
+
+	FloatField<2,2>::add(hyperedges, "dPhi", precision);
+	FloatField<2,2>::add(hyperedges, "strain", precision);
+	FloatField<>::add(hyperedges, "energyDensity", precision);
+	FloatField<4,6>::add(hyperedges, "dDphi", precision);
+	FloatField<4,4>::add(hyperedges, "dStrain", precision);
+	FloatField<4>::add(hyperedges, "dEnergyDensity", precision);
+	FloatField<6>::add(hyperedges, "dEnergy", precision);
+}
+
+Elastic2D::Elastic2D() : precision(DoublePrecision), points(), 
+	hyperedges(points,points,points), profiling(false), memoryReport(false),
+	exportInterval(10), exportSteps(0), exportTime(0.0), nativeEngine(false),
+	nativeTime(0.0), implicit(false),
+	legacy(false), slim(false), perInstance(false), sleeping(false),
+	sleepSpeed(numeric_limits<double>::quiet_NaN()), sleepChecks(10),
+	stepCount(0), compacted(false),
+	adaptive(false), h(0.0), appliedH(0.0), stableH(0.0), lastEnergy(0.0),
+	multigrid(false),
+	plainCG(false) {
+
+	adaptStats.accepted = 0;
+	adaptStats.rejected = 0;
+	solveStats.solves = 0;
+	solveStats.iterations = 0;
+	solveStats.ms = 0.0;
+
+	gravity.set({{0.0, 9.8}});
+	massPerUnitArea = defaultMassPerUnitArea;
 
 }
 
@@ -74,44 +139,83 @@ void Elastic2D::load() {
 
 	srand ( time(NULL) );
 	// Point field references
-    simit::FieldRef<simit_float,2> init_position = 
-    	points.addField<simit_float,2>("init_position");
-    simit::FieldRef<simit_float,2> position = 
-    	points.addField<simit_float,2>("position");
-    simit::FieldRef<simit_float,2> velocity = 
-    	points.addField<simit_float,2>("velocity");
+    FloatField<2> init_position = 
+    	FloatField<2>::add(points, "init_position", precision);
+    FloatField<2> position = 
+    	FloatField<2>::add(points, "position", precision);
+    FloatField<2> velocity = 
+    	FloatField<2>::add(points, "velocity", precision);
     simit::FieldRef<bool> pinned = points.addField<bool>("pinned");
+    simit::FieldRef<bool> asleep;
+    if (sleeping)
+        asleep = points.addField<bool>("asleep");
+    positionField = position;
+    velocityField = velocity;
+    pinnedField = pinned;
     
 	//Hyperedge field references
-    simit::FieldRef<simit_float,2,2> dPhi = 
-    	hyperedges.addField<simit_float,2,2>("dPhi");
-    simit::FieldRef<simit_float,2,2> strain = 
-    	hyperedges.addField<simit_float,2,2>("strain");
-    simit::FieldRef<simit_float> energy = 
-    	hyperedges.addField<simit_float>("energy");
-    simit::FieldRef<simit_float> energyDensity = 
-    	hyperedges.addField<simit_float>("energyDensity");
-    simit::FieldRef<simit_float> init_area = 
-    	hyperedges.addField<simit_float>("init_area");    	
-    simit::FieldRef<simit_float> mass = 
-    	hyperedges.addField<simit_float>("mass");    	
-    simit::FieldRef<simit_float,4,6> dDphi = 
-    	hyperedges.addField<simit_float,4,6>("dDphi");
-    simit::FieldRef<simit_float,4,4> dStrain = 
-    	hyperedges.addField<simit_float,4,4>("dStrain");
-    simit::FieldRef<simit_float,4> dEnergyDensity = 
-    	hyperedges.addField<simit_float,4>("dEnergyDensity");
-    simit::FieldRef<simit_float,6> dEnergy = 
-    	hyperedges.addField<simit_float,6>("dEnergy");
+    FloatField<> energy = 
+    	FloatField<>::add(hyperedges, "energy", precision);
+    FloatField<> init_area = 
+    	FloatField<>::add(hyperedges, "init_area", precision);    	
+    FloatField<> min_edge = 
+    	FloatField<>::add(hyperedges, "min_edge", precision);    	
+    FloatField<> mass = 
+    	FloatField<>::add(hyperedges, "mass", precision);    	
+    FloatField<2,2> DmInv = 
+    	FloatField<2,2>::add(hyperedges, "DmInv", precision);
+    energyField = energy;
+    massField = mass;
+    minEdgeField = min_edge;
+
+    // per-step scratch, the slim program keeps it in registers
+    int fb = floatBytes(precision);
+    if (!slim) {
+    	addScratch(hyperedges, precision);
+    	dEnergyField = FloatField<6>::get(hyperedges, "dEnergy", precision);
+    	memory.addField("hyperedges", "dPhi", 4*fb);
+    	memory.addField("hyperedges", "strain", 4*fb);
+    	memory.addField("hyperedges", "energyDensity", fb);
+    	memory.addField("hyperedges", "dDphi", 24*fb);
+    	memory.addField("hyperedges", "dStrain", 16*fb);
+    	memory.addField("hyperedges", "dEnergyDensity", 4*fb);
+    	memory.addField("hyperedges", "dEnergy", 6*fb);
+    }
  	
-    vector<simit::ElementRef> pointRefs;
+    // one instance reads its time step and material from the parameters
+    // extern, see compile()
+    FloatField<> h, alpha, beta;
+    if (perInstance) {
+        h = FloatField<>::add(points, "h", precision);
+        alpha = FloatField<>::add(hyperedges, "alpha", precision);
+        beta = FloatField<>::add(hyperedges, "beta", precision);
+    }
+
+    // bytes per element of the fields above, counted once the sets are full
+    memory.addField("points", "init_position", init_position.bytes());
+    memory.addField("points", "position", position.bytes());
+    memory.addField("points", "velocity", velocity.bytes());
+    memory.addField("points", "pinned", sizeof(bool));
+    if (sleeping)
+        memory.addField("points", "asleep", sizeof(bool));
+    memory.addField("hyperedges", "energy", energy.bytes());
+    memory.addField("hyperedges", "init_area", init_area.bytes());
+    memory.addField("hyperedges", "min_edge", min_edge.bytes());
+    memory.addField("hyperedges", "mass", mass.bytes());
+    memory.addField("hyperedges", "DmInv", DmInv.bytes());
+    memory.addField("hyperedges", "endpoints", 3*sizeof(int));
+    if (perInstance) {
+        memory.addField("points", "h", h.bytes());
+        memory.addField("hyperedges", "alpha", alpha.bytes());
+        memory.addField("hyperedges", "beta", beta.bytes());
+    }
+
+    // initial velocities are drawn once per mesh vertex so every instance
+    // of a sweep starts from the same state
+    vector<FloatField<2>::Value> initVelocity;
+    vector<bool> initPinned;
     int x = 1;
-    for(auto v : mesh.v) {
-        pointRefs.push_back(points.add());
-        simit::ElementRef pRef = pointRefs.back();
-        
-        init_position.set(pRef, {v[0], v[1]});
-        position.set(pRef, {v[0], v[1]});
+    for(size_t i = 0; i < mesh.v.size(); i++) {
         float dx, dy;    
          	
     	  	dx = ((rand() % 4)-2.0)/1.f; 
@@ -119,72 +223,216 @@ void Elastic2D::load() {
 //			dx = 0.0;
 //			dy = 0.0;
 			//4,3  : 931,961
-			if ((x == 931) ||
-				(x == 961)) {
-  			   	pinned.set(pRef, true);     
+			bool pin = ((x == 931) ||
+						(x == 961));
+			if (pin) {
   			   	dx = 0.0;
   			   	dy = 0.0;
   			   	}
-  			else
-	     		pinned.set(pRef, false);     
 
 		x++;	
-   		velocity.set(pRef, {dx, dy});   
+		initVelocity.push_back({{dx, dy}});
+		initPinned.push_back(pin);
 	}
 
-    for(int idx = 0; idx < mesh.edges.size(); ) {
+    // the vector fields of an instance's points are one block each, written
+    // in bulk once the points exist
+    vector<FloatField<2>::Value> restPosition(mesh.v.size());
+    for (size_t i = 0; i < mesh.v.size(); i++)
+        restPosition[i] = {{mesh.v[i][0], mesh.v[i][1]}};
+
+    // a sweep replicates the mesh once per instance, each copy carrying
+    // its own parameters, so all of them advance in one run()
+    if (instances.empty())
+        instances.push_back(defaultParams);
+
+    pointRefs.clear();
+    hyperedgeRefs.clear();
+    for (const ElasticParams& params : instances) {
+        size_t base = pointRefs.size();
+        for(size_t i = 0; i < mesh.v.size(); i++) {
+            pointRefs.push_back(points.add());
+            simit::ElementRef pRef = pointRefs.back();
+
+            pinned.set(pRef, initPinned[i]);
+            if (sleeping)
+                asleep.set(pRef, false);
+            if (perInstance)
+                h.set(pRef, params.h);
+        }
+        if (!mesh.v.empty()) {
+            size_t nv = mesh.v.size();
+            init_position.setRange(pointRefs[base], nv, restPosition.data());
+            position.setRange(pointRefs[base], nv, restPosition.data());
+            velocity.setRange(pointRefs[base], nv, initVelocity.data());
+        }
+
+        for(int idx = 0; idx < mesh.edges.size(); ) {
     
-    	std::array< int,2> e1 = mesh.edges[idx++];
-    	std::array< int,2> e2 = mesh.edges[idx++];
-    	std::array< int,2> e3 = mesh.edges[idx++];
+        	std::array< int,2> e1 = mesh.edges[idx++];
+        	std::array< int,2> e2 = mesh.edges[idx++];
+        	std::array< int,2> e3 = mesh.edges[idx++];
     	    	
-    	//Check for bad triangles
-    	if (e1[1] != e2[0]) 
-    		cerr << "e1 != e2 : " << e1[1] << ", " << e2[0] << endl;
-    	if (e2[1] != e3[0]) 
-    		cerr << "e2 != e3 : " << e2[1] << ", " << e3[0] << endl;
-    	if (e3[1] != e1[0]) 
-    		cerr << "e3 != e1 : " << e3[1] << ", " << e1[0] << endl;
+        	//Check for bad triangles
+        	if (e1[1] != e2[0]) 
+        		cerr << "e1 != e2 : " << e1[1] << ", " << e2[0] << endl;
+        	if (e2[1] != e3[0]) 
+        		cerr << "e2 != e3 : " << e2[1] << ", " << e3[0] << endl;
+        	if (e3[1] != e1[0]) 
+        		cerr << "e3 != e1 : " << e3[1] << ", " << e1[0] << endl;
     		
-        simit::ElementRef heRef = hyperedges.add(pointRefs[e1[0]], 
-        									    pointRefs[e2[0]],
-        									    pointRefs[e3[0]]); 
-        std::array<double,3> pA = mesh.v[e1[0]];
-        std::array<double,3> pB = mesh.v[e2[0]];   
-        std::array<double,3> pC = mesh.v[e3[0]];   
-           
-		init_area.set(heRef, 0.0);
-      	mass.set(heRef, 0.0);
+            simit::ElementRef heRef = hyperedges.add(pointRefs[base+e1[0]], 
+            									    pointRefs[base+e2[0]],
+            									    pointRefs[base+e3[0]]); 
+            hyperedgeRefs.push_back(heRef);
+    		init_area.set(heRef, restArea[idx/3 - 1]);
+          	mass.set(heRef, restArea[idx/3 - 1] * massPerUnitArea);
+          	if (perInstance) {
+          		alpha.set(heRef, params.alpha);
+          		beta.set(heRef, params.beta);
+          	}
 
+        }
     }
 
-    // Load simit program here
-    string filename = string(toString(SIMIT_CODE_DIR))+"/Elastic2D.sim";
-    FILE *fin = fopen(filename.c_str(), "r");
-   
-    //DBG//cout<<"Loading "<<filename<<"\n";
-    
-    //load simit program
-    int errorCode = program.loadFile(filename);
-
-    if(errorCode) { cout<<program.getDiagnostics().getMessage(); exit(0); }
+    memory.addSet("points", points.getSize());
+    memory.addSet("hyperedges", hyperedges.getSize());
+    if (memoryReport)
+        reportMemory("after load");
 
-    //DBG//cout<<"Compiling \n";
-    precomputation = program.compile("init");
+    // init and main were compiled on a background thread while the sets
+    // were filled; run init as soon as it is ready, then bind main
+    if (!compiled.valid())
+        compile();
+    try {
+        initCompiled.get();
 
-    precomputation.bind("points", &points);
-    precomputation.bind("hyperedges", &hyperedges);
-    precomputation.runSafe();
+        precomputation.bind("points", &points);
+        precomputation.bind("hyperedges", &hyperedges);
+        precomputation.runSafe();
 
-    timeStepper = program.compile("main");
+        compiled.get();
+    } catch (const runtime_error& err) {
+        cout << err.what();
+        exit(0);
+    }
 
     //DBG//cout<<"Binding \n";
-    timeStepper.bind("points", &points);
-    timeStepper.bind("hyperedges", &hyperedges);
+    gravity.bind(timeStepper, "gravity", precision);
+    if (!perInstance) {
+        parameters.set({{instances[0].h, instances[0].alpha,
+                         instances[0].beta}});
+        parameters.bind(timeStepper, "parameters", precision);
+    }
     //DBG//cout<<"Initializing \n";
-    timeStepper.init();
-    
+    bindSets(points, hyperedges);
+    if (sleeping) {
+        // a point is calm below a tenth of a rest edge per unit time, the
+        // edge taken as the leg of a right triangle of the mean rest area
+        if (std::isnan(sleepSpeed)) {
+            double area = 0.0;
+            for (double a : restArea)
+                area += a;
+            area /= max<size_t>(restArea.size(), 1);
+            sleepSpeed = 0.1 * sqrt(2.0 * area);
+        }
+
+        // a triangle's corners are the first ends of its three edges,
+        // 0-based over all instances
+        size_t nv = mesh.v.size();
+        vector<int> ends;
+        ends.reserve(3*hyperedgeRefs.size());
+        for (size_t i = 0; i < instances.size(); i++)
+            for (size_t e = 0; e < mesh.edges.size(); e++)
+                ends.push_back(i*nv + mesh.edges[e][0]);
+        sleep.setElements(pointRefs.size(), 3, 2, ends);
+        sleep.setLimits(sleepSpeed, sleepChecks);
+        compactOf.assign(pointRefs.size(), -1);
+    }
+    if (multigrid)
+        initMultigrid();
+    if (nativeEngine)
+        loadNative();
+    if (!exportName.empty() || !recordPath.empty()) {
+        vector<int> corners;
+        size_t nv = mesh.v.size();
+        for (size_t i = 0; i < instances.size(); i++)
+            for (size_t f = 0; f < mesh.edges.size()/3; f++)
+                for (int c = 0; c < 3; c++)
+                    corners.push_back(i*nv + mesh.edges[3*f+c][0]);
+        if (!exportName.empty())
+            exporter.reset(new StateExport(exportName, pointRefs.size(), 2,
+                                           corners, 3));
+        if (!recordPath.empty())
+            recorder.reset(new TrajectoryWriter(recordPath, pointRefs.size(),
+                                                2, corners, 3));
+        exportPositions.resize(2*pointRefs.size());
+        exportState();
+    }
+    if (memoryReport)
+        reportMemory("after init");
+
+    cout << "Startup: compile " << compileTime << " ms, total "
+         << chrono::duration<double,milli>(
+                chrono::steady_clock::now() - startupBegin).count()
+         << " ms" << endl;
     }
+
+void Elastic2D::compile() {
+
+    startupBegin = chrono::steady_clock::now();
+    initReady = promise<void>();
+    initCompiled = initReady.get_future();
+
+    // Only a sweep has per point time steps and per triangle materials; a
+    // single instance binds them as one extern instead of three fields.
+    perInstance = instances.size() > 1;
+    SimitSource source;
+    source.define(perInstance ? "sweep" : "single");
+    source.define(sleeping ? "sleep" : "nosleep");
+
+    // the temporaries of the procs compiled below come from the arenas
+    StepArena::hookCompiledProcs();
+
+    // Parsing the mesh and JIT compiling the program are independent, so
+    // compilation runs on its own thread until load() needs the Functions.
+    // Both procs share one simit::Program, so they are compiled one after
+    // the other on that thread; init is handed over as soon as it is done.
+    compiled = async(launch::async, [this, source]() {
+        auto start = chrono::steady_clock::now();
+        try {
+            // Load simit program here
+            string filename = string(toString(SIMIT_CODE_DIR)) +
+                              (slim ? "/Elastic2DSlim.sim" : "/Elastic2D.sim");
+
+            //DBG//cout<<"Loading "<<filename<<"\n";
+
+            //load simit program
+            string code;
+            if (!source.read(filename, code))
+                throw runtime_error("Unable to read " + filename + "\n");
+            int errorCode = program.loadString(code);
+
+            if(errorCode) throw runtime_error(program.getDiagnostics().getMessage());
+
+            //DBG//cout<<"Compiling \n";
+            precomputation = program.compile("init");
+            initReady.set_value();
+        } catch (...) {
+            initReady.set_exception(current_exception());
+            throw;
+        }
+
+        // the implicit proc stays stable far past the explicit CFL bound;
+        // the multigrid stepper only asks simit for energies and gradients
+        timeStepper = program.compile(multigrid ? "linearize" :
+                                      implicit ? "implicit" :
+                                      legacy ? "main_legacy" : "main");
+
+        compileTime = chrono::duration<double,milli>(
+                          chrono::steady_clock::now() - start).count();
+    });
+}
     
 void Elastic2D::step() {
 
@@ -243,17 +491,15 @@ void Elastic2D::step() {
 		glTranslatef(panX, panY, 0.f);
 		//DBG//cout<<"Running\n";
 		if (numSteps > 0) {
-			timeStepper.run();
+			advance();
 			numSteps--;
 		} else if (numSteps < 0) {
-			timeStepper.run();
+			advance();
 		}
   
 		//DBG//cout << "Position : Velocity " << endl;
-		simit::FieldRef<simit_float,2> pos = 	
-			points.getField<simit_float,2>("position");
-		simit::FieldRef<simit_float,2> vel = 
-			points.getField<simit_float,2>("velocity");
+		FloatField<2> pos = 	
+			FloatField<2>::get(points, "position", precision);
 		simit::FieldRef<bool> pin = 
 			points.getField<bool>("pinned");
 		
@@ -268,10 +514,10 @@ void Elastic2D::step() {
 				glColor3f(0.f,0.f,0.f);
 			}
 			glBegin(GL_POINTS);
-			glVertex3f((pos.get(p)(0)), 
-   					   (pos.get(p)(1)), 
+			glVertex3f((pos.get(p)[0]), 
+   					   (pos.get(p)[1]), 
 						0.f);
-//					   (pos.get(p)(2)));
+//					   (pos.get(p)[2]));
 			glEnd();
 		}
 
@@ -294,18 +540,18 @@ void Elastic2D::step() {
 
 			glBegin(GL_TRIANGLES);
 			glColor3f(0.f,0.f,0.f);
-			glVertex3f((pos.get(ep0)(0)), 
-						(pos.get(ep0)(1)), 
+			glVertex3f((pos.get(ep0)[0]), 
+						(pos.get(ep0)[1]), 
 						0.f);
-//						(pos.get(ep0)(2)));
-			glVertex3f((pos.get(ep1)(0)), 
-						(pos.get(ep1)(1)), 
+//						(pos.get(ep0)[2]));
+			glVertex3f((pos.get(ep1)[0]), 
+						(pos.get(ep1)[1]), 
 						0.f);
-//						(pos.get(ep1)(2)));	
-			glVertex3f((pos.get(ep2)(0)), 
-						(pos.get(ep2)(1)), 
+//						(pos.get(ep1)[2]));	
+			glVertex3f((pos.get(ep2)[0]), 
+						(pos.get(ep2)[1]), 
 						0.f);
-//						(pos.get(ep2)(2)));												
+//						(pos.get(ep2)[2]));												
 			glEnd();
 
 		}
@@ -315,16 +561,1030 @@ void Elastic2D::step() {
 	}
 	glfwDestroyWindow(window);
 	glfwTerminate();
+	if (adaptive)
+		reportAdaptive();
 	exit(EXIT_SUCCESS);
  
 }
 
+double Elastic2D::systemEnergy() {
+
+	double energy = 0.0;
+	for (size_t i = 0; i < instances.size(); i++)
+		energy += instanceEnergy(i);
+	return energy;
+}
+
+double Elastic2D::instanceEnergy(size_t instance) {
+
+	FloatField<2>& position = positionField;
+	FloatField<2>& velocity = velocityField;
+	FloatField<>& mass = massField;
+	FloatField<>& energy = energyField;
+	simit::FieldRef<bool>& pinned = pinnedField;
+
+	// lumped point masses as in compute_mass; accumulate in double
+	// whatever the program's precision
+	size_t nv = mesh.v.size();
+	size_t nf = mesh.edges.size()/3;
+	vector<double> pointMass(nv, 0.0);
+	double potential = 0.0;
+	for (size_t f = 0; f < nf; f++) {
+		simit::ElementRef tri = hyperedgeRefs[instance*nf + f];
+		double m = mass.get(tri);
+		for (int i = 0; i < 3; i++)
+			pointMass[mesh.edges[3*f+i][0]] += m/3.0;
+		potential += energy.get(tri);
+	}
+
+	FloatExtern<2>::Value g = gravity.get();
+	double kinetic = 0.0;
+	for (size_t i = 0; i < nv; i++) {
+		simit::ElementRef p = pointRefs[instance*nv + i];
+		if (pinned.get(p))
+			continue;
+		FloatField<2>::Value x = position.get(p);
+		FloatField<2>::Value v = velocity.get(p);
+		kinetic += 0.5 * pointMass[i] * (v[0]*v[0] + v[1]*v[1]);
+		// main applies gravity as the force -g
+		potential += g[0]*x[0] + g[1]*x[1];
+	}
+	return kinetic + potential;
+}
+
+void Elastic2D::reportInstances() {
+
+	FloatField<2> position = FloatField<2>::get(points, "position", precision);
+	FloatField<2> velocity = FloatField<2>::get(points, "velocity", precision);
+
+	cout << "instance alpha beta h energy centroid_y max_speed" << endl;
+	size_t nv = mesh.v.size();
+	for (size_t i = 0; i < instances.size(); i++) {
+		double centroidY = 0.0;
+		double maxSpeed = 0.0;
+		for (size_t j = i*nv; j < (i+1)*nv; j++) {
+			FloatField<2>::Value v = velocity.get(pointRefs[j]);
+			centroidY += position.get(pointRefs[j])[1];
+			maxSpeed = max(maxSpeed, sqrt(v[0]*v[0] + v[1]*v[1]));
+		}
+		cout << i << " " << instances[i].alpha << " " << instances[i].beta
+			 << " " << instances[i].h << " " << instanceEnergy(i) << " "
+			 << centroidY/nv << " " << maxSpeed << endl;
+	}
+}
+
+void Elastic2D::setParams(size_t instance, const ElasticParams& params) {
+
+	instances[instance] = params;
+	if (pointRefs.empty())
+		return;
+
+	// rewrite the instance's fields or the bound extern in place, the
+	// compiled Function reads them at its next run() so nothing is
+	// recompiled
+	if (!perInstance) {
+		parameters.set({{params.h, params.alpha, params.beta}});
+		return;
+	}
+	FloatField<> h = FloatField<>::get(points, "h", precision);
+	FloatField<> alpha = FloatField<>::get(hyperedges, "alpha", precision);
+	FloatField<> beta = FloatField<>::get(hyperedges, "beta", precision);
+	size_t nv = mesh.v.size();
+	for (size_t i = instance*nv; i < (instance+1)*nv; i++)
+		h.set(pointRefs[i], params.h);
+	size_t nf = mesh.edges.size()/3;
+	for (size_t i = instance*nf; i < (instance+1)*nf; i++) {
+		alpha.set(hyperedgeRefs[i], params.alpha);
+		beta.set(hyperedgeRefs[i], params.beta);
+	}
+	if (compacted)
+		compactSets();
+}
+
+bool Elastic2D::setParameter(const string& name, double value) {
+
+	if (name == "gravity") {
+		gravity.set({{0.0, value}});
+		return true;
+	}
+	if (name == "massperunitarea") {
+		// before load() the mass field does not exist yet, and load()
+		// sets it from massPerUnitArea
+		massPerUnitArea = value;
+		if (hyperedgeRefs.empty())
+			return true;
+		size_t nf = restArea.size();
+		for (size_t i = 0; i < hyperedgeRefs.size(); i++)
+			massField.set(hyperedgeRefs[i], restArea[i % nf] * massPerUnitArea);
+		if (compacted)
+			compactSets();
+		return true;
+	}
+	if ((name == "sleepspeed") || (name == "sleepchecks")) {
+		if (name == "sleepspeed")
+			sleepSpeed = value;
+		else
+			sleepChecks = max(1, (int)value);
+		sleep.setLimits(sleepSpeed, sleepChecks);
+		return true;
+	}
+
+	if (instances.empty())
+		instances.push_back(defaultParams);
+	for (size_t i = 0; i < instances.size(); i++) {
+		ElasticParams params = instances[i];
+		if (name == "alpha")
+			params.alpha = value;
+		else if (name == "beta")
+			params.beta = value;
+		else if (name == "h")
+			params.h = value;
+		else {
+			cerr << "Unknown parameter " << name << endl;
+			return false;
+		}
+		setParams(i, params);
+	}
+	return true;
+}
+
+bool Elastic2D::loadSweep(const char * file_name) {
+
+	// one instance per line: alpha beta h
+	ifstream in(file_name);
+	if (!in) {
+		cerr << "Unable to open " << file_name << endl;
+		return false;
+	}
+	ElasticParams params;
+	instances.clear();
+	while (in >> params.alpha >> params.beta >> params.h)
+		instances.push_back(params);
+	cout << "Number of instances loaded: " << instances.size() << endl;
+	return !instances.empty();
+}
+
+void Elastic2D::reportMemory(const string& phase) {
+
+	// the temporaries of the step proc at their peak, and the rest of its
+	// arena, which bump allocation does not reuse within a run; the
+	// multigrid matrices live in Eigen and are not counted
+	memory.setOther("temporaries of the step proc at their peak",
+					stepArena.peak());
+	memory.setOther("rest of the arena of the step proc",
+					stepArena.capacity() - min(stepArena.peak(),
+											   stepArena.capacity()));
+	memory.setOther("host mesh and element refs",
+					mesh.v.size()*sizeof(mesh.v[0]) +
+					mesh.edges.size()*sizeof(mesh.edges[0]) +
+					restArea.size()*sizeof(double) +
+					(pointRefs.size() + hyperedgeRefs.size()) *
+						sizeof(simit::ElementRef));
+	memory.print(cout, phase);
+}
+
+void Elastic2D::runStep() {
+
+	// with every point asleep there is nothing to step
+	if (compacted && activePoints.empty())
+		return;
+	StepArena::Scope scope(stepArena);
+	stepCounters.start();
+	timeStepper.run();
+	stepCounters.stop();
+	if (compacted)
+		scatter();
+}
+
+void Elastic2D::advance() {
+
+	double h0 = instances.empty() ? defaultParams.h : instances[0].h;
+	double taken = h0;
+	if (multigrid)
+		multigridStep();
+	else if (adaptive)
+		taken = adaptiveStep();
+	else if (native)
+		nativeStep();
+	else
+		runStep();
+	if (sleeping && (++stepCount % sleepInterval == 0))
+		settle();
+
+	if (exporter || recorder) {
+		exportTime += taken;
+		if (++exportSteps % exportInterval == 0)
+			exportState();
+	}
+}
+
+void Elastic2D::settle() {
+
+	// only the awake points are observed, from the set main ran on
+	for (size_t p : sleep.awake()) {
+		FloatField<2>::Value v = compacted
+			? awakeVelocity.get(awakePointRefs[compactOf[p]])
+			: velocityField.get(pointRefs[p]);
+		sleep.observe(p, v.data());
+	}
+	if (!sleep.settle())
+		return;
+
+	simit::FieldRef<bool> asleep = points.getField<bool>("asleep");
+	for (size_t p : sleep.fellAsleep()) {
+		asleep.set(pointRefs[p], true);
+		velocityField.set(pointRefs[p], {{0.0, 0.0}});
+	}
+	for (size_t p : sleep.woke())
+		asleep.set(pointRefs[p], false);
+	compactSets();
+}
+
+void Elastic2D::bindSets(simit::Set& stepPoints, simit::Set& stepTriangles) {
+
+	timeStepper.bind("points", &stepPoints);
+	timeStepper.bind("hyperedges", &stepTriangles);
+	timeStepper.init();
+}
+
+void Elastic2D::compactSets() {
+
+	for (size_t p : activePoints)
+		compactOf[p] = -1;
+	if (sleep.awake().size() == sleep.points()) {
+		activePoints.clear();
+		activeTriangles.clear();
+		if (compacted)
+			bindSets(points, hyperedges);
+		compacted = false;
+		awakeTriangles.reset();
+		awakePoints.reset();
+		return;
+	}
+	compacted = true;
+	sleep.compact(activePoints, activeTriangles);
+	awakePointRefs.clear();
+	awakeTriangleRefs.clear();
+	if (activePoints.empty()) {
+		awakeTriangles.reset();
+		awakePoints.reset();
+		return;
+	}
+
+	// copies of the active triangles and their points, from the full sets,
+	// which are current: runStep() scattered the awake points and settle()
+	// wrote the sleepers. init fills in the rest data it computes, the
+	// per-step scratch of the full HyperEdge is only there for main to bind.
+	unique_ptr<simit::Set> stepPoints(new simit::Set());
+	unique_ptr<simit::Set> stepTriangles(
+		new simit::Set(*stepPoints, *stepPoints, *stepPoints));
+	FloatField<2> init_position =
+		FloatField<2>::add(*stepPoints, "init_position", precision);
+	FloatField<2> position =
+		FloatField<2>::add(*stepPoints, "position", precision);
+	FloatField<2> velocity =
+		FloatField<2>::add(*stepPoints, "velocity", precision);
+	simit::FieldRef<bool> pinned = stepPoints->addField<bool>("pinned");
+	simit::FieldRef<bool> asleep = stepPoints->addField<bool>("asleep");
+	FloatField<> energy =
+		FloatField<>::add(*stepTriangles, "energy", precision);
+	FloatField<> init_area =
+		FloatField<>::add(*stepTriangles, "init_area", precision);
+	FloatField<>::add(*stepTriangles, "min_edge", precision);
+	FloatField<> mass = FloatField<>::add(*stepTriangles, "mass", precision);
+	FloatField<2,2>::add(*stepTriangles, "DmInv", precision);
+	if (!slim)
+		addScratch(*stepTriangles, precision);
+	FloatField<> h, alpha, beta, fullH, fullAlpha, fullBeta;
+	if (perInstance) {
+		h = FloatField<>::add(*stepPoints, "h", precision);
+		alpha = FloatField<>::add(*stepTriangles, "alpha", precision);
+		beta = FloatField<>::add(*stepTriangles, "beta", precision);
+		fullH = FloatField<>::get(points, "h", precision);
+		fullAlpha = FloatField<>::get(hyperedges, "alpha", precision);
+		fullBeta = FloatField<>::get(hyperedges, "beta", precision);
+	}
+
+	FloatField<2> fullInitPosition =
+		FloatField<2>::get(points, "init_position", precision);
+	simit::FieldRef<bool> fullPinned = points.getField<bool>("pinned");
+	simit::FieldRef<bool> fullAsleep = points.getField<bool>("asleep");
+	for (size_t i = 0; i < activePoints.size(); i++) {
+		simit::ElementRef from = pointRefs[activePoints[i]];
+		simit::ElementRef to = stepPoints->add();
+		awakePointRefs.push_back(to);
+		compactOf[activePoints[i]] = i;
+		init_position.set(to, fullInitPosition.get(from));
+		position.set(to, positionField.get(from));
+		velocity.set(to, velocityField.get(from));
+		pinned.set(to, fullPinned.get(from));
+		asleep.set(to, fullAsleep.get(from));
+		if (perInstance)
+			h.set(to, fullH.get(from));
+	}
+
+	FloatField<> fullInitArea =
+		FloatField<>::get(hyperedges, "init_area", precision);
+	size_t nv = mesh.v.size(), nf = mesh.edges.size()/3;
+	for (size_t t : activeTriangles) {
+		size_t base = (t/nf)*nv, f = t%nf;
+		simit::ElementRef to = stepTriangles->add(
+			awakePointRefs[compactOf[base + mesh.edges[3*f][0]]],
+			awakePointRefs[compactOf[base + mesh.edges[3*f+1][0]]],
+			awakePointRefs[compactOf[base + mesh.edges[3*f+2][0]]]);
+		awakeTriangleRefs.push_back(to);
+		simit::ElementRef from = hyperedgeRefs[t];
+		energy.set(to, energyField.get(from));
+		init_area.set(to, fullInitArea.get(from));
+		mass.set(to, massField.get(from));
+		if (perInstance) {
+			alpha.set(to, fullAlpha.get(from));
+			beta.set(to, fullBeta.get(from));
+		}
+	}
+	precomputation.bind("points", stepPoints.get());
+	precomputation.bind("hyperedges", stepTriangles.get());
+	precomputation.runSafe();
+
+	// bind the new sets before the old ones go, triangles before the
+	// points they refer to
+	bindSets(*stepPoints, *stepTriangles);
+	awakeTriangles = std::move(stepTriangles);
+	awakePoints = std::move(stepPoints);
+	awakePosition = position;
+	awakeVelocity = velocity;
+	awakeEnergy = energy;
+}
+
+void Elastic2D::scatter() {
+
+	// the sleeping points of the awake sets do not move
+	for (size_t p : sleep.awake()) {
+		simit::ElementRef from = awakePointRefs[compactOf[p]];
+		positionField.set(pointRefs[p], awakePosition.get(from));
+		velocityField.set(pointRefs[p], awakeVelocity.get(from));
+	}
+	for (size_t i = 0; i < activeTriangles.size(); i++)
+		energyField.set(hyperedgeRefs[activeTriangles[i]],
+						awakeEnergy.get(awakeTriangleRefs[i]));
+}
+
+void Elastic2D::loadNative() {
+
+	simit::FieldRef<bool> pinned = points.getField<bool>("pinned");
+
+	if (precision == SinglePrecision)
+		native.reset(new NativeEngine<float,2,TriangleElement>());
+	else
+		native.reset(new NativeEngine<double,2,TriangleElement>());
+	native->resize(pointRefs.size(), hyperedgeRefs.size());
+
+	// lumped masses as in compute_mass, zero and so never moved for
+	// pinned points; main applies gravity as the force -g
+	size_t nv = mesh.v.size();
+	size_t nf = mesh.edges.size()/3;
+	vector<double> pointMass(pointRefs.size(), 0.0);
+	for (size_t t = 0; t < hyperedgeRefs.size(); t++)
+		for (int i = 0; i < 3; i++)
+			pointMass[(t/nf)*nv + mesh.edges[3*(t%nf)+i][0]] +=
+				restArea[t%nf] * massPerUnitArea / 3.0;
+	FloatExtern<2>::Value g = gravity.get();
+	double load[2] = { -g[0], -g[1] };
+	for (size_t i = 0; i < pointRefs.size(); i++) {
+		simit::ElementRef p = pointRefs[i];
+		FloatField<2>::Value x = positionField.get(p);
+		FloatField<2>::Value v = velocityField.get(p);
+		double invMass = pinned.get(p) ? 0.0 : 1.0/pointMass[i];
+		native->setPoint(i, x.data(), v.data(), instances[i/nv].h, invMass,
+						 0.0, load);
+	}
+
+	// Dm from the rest positions, which init_position holds
+	for (size_t t = 0; t < hyperedgeRefs.size(); t++) {
+		size_t f = t % nf;
+		int ends[3];
+		std::array<double,3> v[3];
+		for (int i = 0; i < 3; i++) {
+			ends[i] = (int)((t/nf)*nv + mesh.edges[3*f+i][0]);
+			v[i] = mesh.v[mesh.edges[3*f+i][0]];
+		}
+		const ElasticParams& params = instances[t/nf];
+		double elementParams[7] = { params.alpha, params.beta, restArea[f],
+									v[0][0]-v[2][0], v[1][0]-v[2][0],
+									v[0][1]-v[2][1], v[1][1]-v[2][1] };
+		native->setElement(t, ends, elementParams);
+	}
+}
+
+void Elastic2D::nativeStep() {
+
+	auto start = chrono::steady_clock::now();
+	stepCounters.start();
+	native->step();
+	stepCounters.stop();
+	nativeTime += chrono::duration<double,milli>(
+					  chrono::steady_clock::now() - start).count();
+
+	FloatField<2>::Value x, v;
+	for (size_t i = 0; i < pointRefs.size(); i++) {
+		native->getState(i, x.data(), v.data());
+		positionField.set(pointRefs[i], x);
+		velocityField.set(pointRefs[i], v);
+	}
+}
+
+// Runs main for numSteps from the current state into referencePosition,
+// then restores that state; returns the milliseconds main took.
+double Elastic2D::referenceRun(int numSteps) {
+
+	size_t n = pointRefs.size();
+	vector<FloatField<2>::Value> x(n), v(n);
+	for (size_t i = 0; i < n; i++) {
+		x[i] = positionField.get(pointRefs[i]);
+		v[i] = velocityField.get(pointRefs[i]);
+	}
+
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < numSteps; i++)
+		runStep();
+	double ms = chrono::duration<double,milli>(
+					chrono::steady_clock::now() - start).count();
+
+	referencePosition.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		referencePosition[i] = positionField.get(pointRefs[i]);
+		positionField.set(pointRefs[i], x[i]);
+		velocityField.set(pointRefs[i], v[i]);
+		native->setState(i, x[i].data(), v[i].data());
+	}
+	return ms;
+}
+
+void Elastic2D::exportState() {
+
+	FloatField<2>& position = positionField;
+	for (size_t i = 0; i < pointRefs.size(); i++) {
+		FloatField<2>::Value x = position.get(pointRefs[i]);
+		exportPositions[2*i] = (float)x[0];
+		exportPositions[2*i + 1] = (float)x[1];
+	}
+	if (exporter)
+		exporter->publish(exportSteps, exportTime, exportPositions.data());
+	if (recorder)
+		recorder->write(exportSteps, exportTime, exportPositions.data());
+}
+
+void Elastic2D::initAdaptive() {
+
+	// the explicit update is stable below the time a wave needs to cross
+	// the shortest rest edge, c = sqrt((2 alpha + beta) / rho)
+	FloatField<>& min_edge = minEdgeField;
+	// (backward Euler has no such bound, steps are only limited by accuracy)
+	stableH = numeric_limits<double>::infinity();
+	size_t nf = mesh.edges.size()/3;
+	for (size_t t = 0; t < hyperedgeRefs.size(); t++) {
+		if (implicit)
+			continue;
+		const ElasticParams& params = instances[t/nf];
+		double c = sqrt((2.0*params.alpha + params.beta)/massPerUnitArea);
+		stableH = min(stableH, adaptCfl * min_edge.get(hyperedgeRefs[t]) / c);
+	}
+
+	h = instances.empty() ? defaultParams.h : instances[0].h;
+	h = min(h, stableH);
+	appliedH = numeric_limits<double>::quiet_NaN();
+	lastEnergy = systemEnergy();
+	adaptStats.accepted = 0;
+	adaptStats.rejected = 0;
+	adaptStats.time = 0.0;
+	adaptStats.minH = numeric_limits<double>::infinity();
+	adaptStats.maxH = 0.0;
+}
+
+double Elastic2D::adaptiveStep() {
+
+	FloatField<2>& position = positionField;
+	FloatField<2>& velocity = velocityField;
+	FloatField<>& min_edge = minEdgeField;
+
+	if (adaptStats.accepted + adaptStats.rejected == 0)
+		initAdaptive();
+
+	size_t nv = mesh.v.size();
+	size_t nf = mesh.edges.size()/3;
+	savedPosition.resize(pointRefs.size());
+	savedVelocity.resize(pointRefs.size());
+	for (size_t i = 0; i < pointRefs.size(); i++) {
+		savedPosition[i] = position.get(pointRefs[i]);
+		savedVelocity[i] = velocity.get(pointRefs[i]);
+	}
+
+	while (true) {
+		// only the time step changes, and only when h does; adaptive
+		// runs have a single instance, so it is the parameters extern
+		if (h != appliedH) {
+			const ElasticParams& params = instances[0];
+			parameters.set({{h, params.alpha, params.beta}});
+			appliedH = h;
+		}
+		runStep();
+
+		double energy = systemEnergy();
+		double scale = max(max(fabs(energy), fabs(lastEnergy)), 1e-12);
+		double error = fabs(energy - lastEnergy)/scale;
+
+		// largest strain rate over all triangles, |v_a - v_b| / h_e
+		double maxRate = 0.0;
+		for (size_t t = 0; t < hyperedgeRefs.size(); t++) {
+			size_t base = (t/nf)*nv;
+			size_t f = t % nf;
+			FloatField<2>::Value v[3];
+			for (int i = 0; i < 3; i++)
+				v[i] = velocity.get(pointRefs[base + mesh.edges[3*f+i][0]]);
+			double dv = 0.0;
+			for (int i = 0; i < 3; i++) {
+				int j = (i+1) % 3;
+				dv = max(dv, sqrt((v[i][0]-v[j][0])*(v[i][0]-v[j][0]) +
+								  (v[i][1]-v[j][1])*(v[i][1]-v[j][1])));
+			}
+			maxRate = max(maxRate, dv/min_edge.get(hyperedgeRefs[t]));
+		}
+
+		bool finite = std::isfinite(energy) && std::isfinite(maxRate);
+		if (finite && ((error <= adaptEnergyTol) || (h <= adaptMinH))) {
+			double accepted = h;
+			adaptStats.accepted++;
+			adaptStats.time += h;
+			adaptStats.minH = min(adaptStats.minH, h);
+			adaptStats.maxH = max(adaptStats.maxH, h);
+			lastEnergy = energy;
+
+			// grow on a calm state, bounded by the energy error, the strain
+			// rate and the CFL step
+			double grow = (error > 0.0) ?
+						  0.9*sqrt(adaptEnergyTol/error) : adaptGrow;
+			double next = h * min(adaptGrow, max(adaptShrink, grow));
+			if (maxRate > 0.0)
+				next = min(next, adaptStrainStep/maxRate);
+			h = max(min(next, stableH), adaptMinH);
+			return accepted;
+		}
+
+		// unstable, roll back and retry with a smaller step; a state that
+		// blows up even at the smallest step is left as it was
+		adaptStats.rejected++;
+		for (size_t i = 0; i < pointRefs.size(); i++) {
+			position.set(pointRefs[i], savedPosition[i]);
+			velocity.set(pointRefs[i], savedVelocity[i]);
+		}
+		if (h <= adaptMinH)
+			return 0.0;
+		h = max(h*adaptShrink, adaptMinH);
+	}
+}
+
+// ∂²(A_i W)/∂x² of one triangle with edge matrix Ds, the same matrix as
+// compute_hessian in Elastic2D.sim: column k is A_i dP Dm⁻ᵀ for a unit
+// move dDs of coordinate k, dP = F dS + dF S, where the dF S term is only
+// kept while S is positive semi-definite.
+static Eigen::Matrix<double,6,6> triangleHessian(const Eigen::Matrix2d& Ds,
+		const Eigen::Matrix2d& DmInv, double area, double alpha, double beta) {
+
+	Eigen::Matrix2d I = Eigen::Matrix2d::Identity();
+	Eigen::Matrix2d F = Ds * DmInv;
+	Eigen::Matrix2d E = 0.5 * (F.transpose()*F - I);
+	Eigen::Matrix2d S = 2.0*alpha*E + (beta*E.trace())*I;
+	bool psd = (S.trace() >= 0.0) && (S.determinant() >= 0.0);
+
+	Eigen::Matrix<double,6,6> H;
+	for (int k = 0; k < 6; k++) {
+		// Ds = [x1-x3, x2-x3], so the third vertex moves both columns
+		Eigen::Matrix2d dDs = Eigen::Matrix2d::Zero();
+		if (k < 4) {
+			dDs(k%2, k/2) = 1.0;
+		} else {
+			dDs(k%2, 0) = -1.0;
+			dDs(k%2, 1) = -1.0;
+		}
+		Eigen::Matrix2d dF = dDs * DmInv;
+		Eigen::Matrix2d dE = 0.5 * (dF.transpose()*F + F.transpose()*dF);
+		Eigen::Matrix2d dS = 2.0*alpha*dE + (beta*dE.trace())*I;
+		Eigen::Matrix2d dP = F*dS;
+		if (psd)
+			dP += dF*S;
+		Eigen::Matrix2d G = area * dP * DmInv.transpose();
+		H(0,k) = G(0,0);
+		H(1,k) = G(1,0);
+		H(2,k) = G(0,1);
+		H(3,k) = G(1,1);
+		H(4,k) = -G(0,0) - G(0,1);
+		H(5,k) = -G(1,0) - G(1,1);
+	}
+	return H;
+}
+
+void Elastic2D::initMultigrid() {
+
+	size_t nf = mesh.edges.size()/3;
+	restInverse.resize(nf);
+	double edgeSum = 0.0;
+	for (size_t f = 0; f < nf; f++) {
+		std::array<double,3> v[3];
+		for (int i = 0; i < 3; i++)
+			v[i] = mesh.v[mesh.edges[3*f+i][0]];
+		Eigen::Matrix2d Dm;
+		Dm << v[0][0]-v[2][0], v[1][0]-v[2][0],
+			  v[0][1]-v[2][1], v[1][1]-v[2][1];
+		restInverse[f] = Dm.inverse();
+		for (int i = 0; i < 3; i++)
+			edgeSum += hypot(v[(i+1)%3][0]-v[i][0], v[(i+1)%3][1]-v[i][1]);
+	}
+
+	// plain CG solves never use the coarse level
+	if (plainCG) {
+		cout << "Multigrid: plain CG, no coarse level" << endl;
+		return;
+	}
+	if (coarseMesh.v.empty())
+		coarseMesh = TwoLevelSolver::decimate(mesh,
+						coarseCells * edgeSum / max<size_t>(3*nf, 1));
+	solver.setMeshes(mesh, coarseMesh, instances.size());
+	cout << "Multigrid: " << mesh.v.size() << " fine, " << coarseMesh.v.size()
+		 << " coarse points per instance" << endl;
+}
+
+void Elastic2D::multigridStep() {
+
+	FloatField<2>& position = positionField;
+	FloatField<2>& velocity = velocityField;
+	FloatField<>& energy = energyField;
+	FloatField<6>& dEnergy = dEnergyField;
+	simit::FieldRef<bool>& pinned = pinnedField;
+
+	// Φ(x) = ½ (x - x̂)' M/h² (x - x̂) + V(x) + g'x as in the implicit proc,
+	// with pinned points held by an identity row
+	size_t n = pointRefs.size();
+	size_t nv = mesh.v.size();
+	size_t nf = mesh.edges.size()/3;
+	FloatExtern<2>::Value g = gravity.get();
+	Eigen::VectorXd x0(2*n), x(2*n), xhat(2*n), inertia(2*n), load(2*n);
+	vector<bool> pin(n);
+	inertia.setZero();
+	for (size_t t = 0; t < hyperedgeRefs.size(); t++)
+		for (int i = 0; i < 3; i++) {
+			size_t p = (t/nf)*nv + mesh.edges[3*(t%nf)+i][0];
+			double m = restArea[t%nf] * massPerUnitArea / 3.0;
+			inertia[2*p] += m;
+			inertia[2*p+1] += m;
+		}
+	for (size_t p = 0; p < n; p++) {
+		double hp = instances[p/nv].h;
+		FloatField<2>::Value xp = position.get(pointRefs[p]);
+		FloatField<2>::Value vp = velocity.get(pointRefs[p]);
+		pin[p] = pinned.get(pointRefs[p]);
+		for (int d = 0; d < 2; d++) {
+			x0[2*p+d] = xp[d];
+			xhat[2*p+d] = xp[d] + hp*vp[d];
+			inertia[2*p+d] = pin[p] ? 1.0 : inertia[2*p+d]/(hp*hp);
+			load[2*p+d] = pin[p] ? 0.0 : g[d];
+		}
+	}
+
+	// runs linearize at x and returns Φ(x)
+	auto evaluate = [&](const Eigen::VectorXd& x) {
+		for (size_t p = 0; p < n; p++)
+			position.set(pointRefs[p], {{x[2*p], x[2*p+1]}});
+		runStep();
+		double phi = 0.0;
+		for (simit::ElementRef tri : hyperedgeRefs)
+			phi += energy.get(tri);
+		for (size_t i = 0; i < 2*n; i++) {
+			double dx = x[i] - xhat[i];
+			phi += 0.5*inertia[i]*dx*dx + load[i]*x[i];
+		}
+		return phi;
+	};
+
+	// the Newton system and its vectors keep their storage between
+	// iterations and steps
+	vector<Eigen::Triplet<double> >& entries = hessianEntries;
+	TwoLevelSolver::Matrix& A = hessian;
+	Eigen::VectorXd& grad = newtonGrad;
+	Eigen::VectorXd& d = newtonStep;
+	Eigen::VectorXd& xt = newtonTrial;
+	x = x0;
+	double phi = evaluate(x);
+	for (int newton = 0; newton < newtonIterations; newton++) {
+		grad = inertia.cwiseProduct(x - xhat) + load;
+		entries.clear();
+		for (size_t i = 0; i < 2*n; i++)
+			entries.push_back(Eigen::Triplet<double>(i, i, inertia[i]));
+		for (size_t t = 0; t < hyperedgeRefs.size(); t++) {
+			size_t base = (t/nf)*nv;
+			size_t f = t % nf;
+			size_t p[3];
+			for (int i = 0; i < 3; i++)
+				p[i] = base + mesh.edges[3*f+i][0];
+			FloatField<6>::Value dE = dEnergy.get(hyperedgeRefs[t]);
+			Eigen::Matrix2d Ds;
+			Ds << x[2*p[0]]-x[2*p[2]], x[2*p[1]]-x[2*p[2]],
+				  x[2*p[0]+1]-x[2*p[2]+1], x[2*p[1]+1]-x[2*p[2]+1];
+			const ElasticParams& params = instances[t/nf];
+			Eigen::Matrix<double,6,6> H = triangleHessian(Ds, restInverse[f],
+								restArea[f], params.alpha, params.beta);
+			for (int i = 0; i < 3; i++) {
+				if (pin[p[i]])
+					continue;
+				grad[2*p[i]] += dE[2*i];
+				grad[2*p[i]+1] += dE[2*i+1];
+				for (int j = 0; j < 3; j++) {
+					if (pin[p[j]])
+						continue;
+					for (int a = 0; a < 2; a++)
+						for (int b = 0; b < 2; b++)
+							entries.push_back(Eigen::Triplet<double>(
+								2*p[i]+a, 2*p[j]+b, H(2*i+a, 2*j+b)));
+				}
+			}
+		}
+		fillHessian(2*n, pin);
+
+		auto start = chrono::steady_clock::now();
+		solveCounters.start();
+		solver.setMatrix(A, plainCG);
+		solveStats.iterations += solver.solve(grad, d, solveTol,
+											  solveMaxIterations, plainCG);
+		d = -d;
+		solveCounters.stop();
+		solveStats.ms += chrono::duration<double,milli>(
+							 chrono::steady_clock::now() - start).count();
+		solveStats.solves++;
+
+		// backtrack until Φ decreases sufficiently
+		double slope = grad.dot(d);
+		double t = 1.0;
+		while (true) {
+			xt = x + t*d;
+			double phiT = evaluate(xt);
+			if ((phiT <= phi + 1e-4*t*slope) || (t < 1e-3)) {
+				phi = phiT;
+				break;
+			}
+			t = 0.5 * t;
+		}
+		x = xt;
+		if (t*t*d.squaredNorm() < 1e-20)
+			break;
+	}
+
+	// the fields already hold the last evaluated positions
+	for (size_t p = 0; p < n; p++) {
+		double hp = instances[p/nv].h;
+		velocity.set(pointRefs[p], {{(x[2*p] - x0[2*p])/hp,
+									 (x[2*p+1] - x0[2*p+1])/hp}});
+	}
+}
+
+void Elastic2D::fillHessian(size_t dofs, const vector<bool>& pin) {
+
+	// the entries come in the same order while the same points are pinned,
+	// so after the first assembly each one is added to its known slot
+	if ((pin != hessianPinned) || (hessianSlot.size() != hessianEntries.size())
+		|| ((size_t)hessian.rows() != dofs)) {
+		hessian.resize(dofs, dofs);
+		hessian.setFromTriplets(hessianEntries.begin(), hessianEntries.end());
+		hessianSlot.resize(hessianEntries.size());
+		for (size_t k = 0; k < hessianEntries.size(); k++) {
+			const Eigen::Triplet<double>& e = hessianEntries[k];
+			const int* first = hessian.innerIndexPtr() +
+							   hessian.outerIndexPtr()[e.col()];
+			const int* last = hessian.innerIndexPtr() +
+							  hessian.outerIndexPtr()[e.col()+1];
+			hessianSlot[k] = (int)(lower_bound(first, last, e.row()) -
+								   hessian.innerIndexPtr());
+		}
+		hessianPinned = pin;
+		return;
+	}
+	double* values = hessian.valuePtr();
+	fill(values, values + hessian.nonZeros(), 0.0);
+	for (size_t k = 0; k < hessianEntries.size(); k++)
+		values[hessianSlot[k]] += hessianEntries[k].value();
+}
+
+void Elastic2D::reportSolves() {
+
+	int solves = max(solveStats.solves, 1);
+	cout << "Solver: " << (plainCG ? "CG" : "two-level PCG") << ", "
+		 << solveStats.solves << " Newton solves, "
+		 << (double)solveStats.iterations/solves << " iterations/solve, "
+		 << solveStats.ms/solves << " ms/solve" << endl;
+}
+
+void Elastic2D::reportAdaptive() {
+
+	cout << "Adaptive: " << adaptStats.accepted << " accepted, "
+		 << adaptStats.rejected << " rejected steps, simulated "
+		 << adaptStats.time << " s, h in [" << adaptStats.minH << ", "
+		 << adaptStats.maxH << "], CFL bound " << stableH << endl;
+}
+
+void Elastic2D::bench(int numSteps) {
+
+	// the arena only serves the benchmarked steps; energy fields are only
+	// written by main, take one step first
+	StepArena::enable(true);
+	double h0 = instances.empty() ? defaultParams.h : instances[0].h;
+	if (!adaptive)
+		runStep();
+	double startEnergy = systemEnergy();
+
+	// main from the same state first, for the native engine to match
+	double referenceMs = 0.0;
+	if (native) {
+		referenceMs = referenceRun(numSteps);
+		nativeTime = 0.0;
+	}
+
+	if (profiling) {
+		stepCounters.open();
+		stepCounters.reset();
+		if (multigrid) {
+			solveCounters.open();
+			solveCounters.reset();
+		}
+	}
+
+	size_t heapBefore = StepArena::heapAllocations();
+	auto start = chrono::steady_clock::now();
+	// an adaptive run covers the simulated time of numSteps fixed steps,
+	// or gives up after adaptBenchLimit attempts per fixed step when h
+	// stays near adaptMinH
+	if (adaptive) {
+		long limit = (long)adaptBenchLimit * numSteps;
+		do {
+			advance();
+		} while ((adaptStats.time < numSteps*h0) &&
+				 (adaptStats.accepted + adaptStats.rejected < limit));
+	} else {
+		for (int i = 0; i < numSteps; i++) {
+			size_t active = sleep.activeElements();
+			auto stepStart = chrono::steady_clock::now();
+			advance();
+			if (sleeping)
+				sleep.addStep(active, chrono::duration<double,milli>(
+								  chrono::steady_clock::now() -
+								  stepStart).count());
+		}
+	}
+	double ms = chrono::duration<double,milli>(
+					chrono::steady_clock::now() - start).count();
+	StepArena::enable(false);
+	if (adaptive) {
+		if (adaptStats.time < numSteps*h0)
+			cout << "Adaptive: stopped after " << numSteps*adaptBenchLimit
+				 << " attempts at " << adaptStats.time << " of "
+				 << numSteps*h0 << " s" << endl;
+		numSteps = adaptStats.accepted + adaptStats.rejected;
+	}
+
+	size_t heapAllocations = StepArena::heapAllocations() - heapBefore;
+
+	// the energy field is main's, from the last step of the reference run
+	if (native) {
+		for (size_t t = 0; t < hyperedgeRefs.size(); t++)
+			energyField.set(hyperedgeRefs[t], native->elementEnergy(t));
+	}
+	double endEnergy = systemEnergy();
+
+	// init_position, position, velocity, in a sweep h, per point and the
+	// floats of a HyperEdge a step touches, each read or written at least
+	// once per step; main, full or slim, only touches those the slim
+	// HyperEdge keeps, the other steppers the per-step scratch as well
+	int fb = floatBytes(precision);
+	int parameterFloats = perInstance ? 2 : 0;
+	int triangleBytes = ((slim ? slimHyperEdgeFloats : hyperEdgeFloats) +
+						 parameterFloats)*fb;
+	bool scratch = !slim && (legacy || implicit || multigrid);
+	int touchedBytes = ((scratch ? hyperEdgeFloats : slimHyperEdgeFloats) +
+						parameterFloats)*fb;
+	double pointFloats = perInstance ? 7.0 : 6.0;
+	double stateBytes = points.getSize() * (pointFloats*fb + sizeof(bool)) +
+						hyperedges.getSize() * (double)touchedBytes;
+
+	cout << "Precision: " << ((precision == SinglePrecision) ?
+			"float32" : "double") << endl;
+	cout << "Instances: " << instances.size() << endl;
+	cout << "Steps: " << numSteps << ", " << ms/numSteps << " ms/step, "
+		 << hyperedges.getSize()*numSteps/(ms*1e3) << " Mtriangles/s" << endl;
+	cout << "Storage: " << (slim ? "slim, " : "full, ") << triangleBytes
+		 << " bytes/triangle" << endl;
+	cout << "State: " << stateBytes/1e6 << " MB, "
+		 << stateBytes*numSteps/(ms*1e6) << " GB/s lower bound" << endl;
+	cout << "Energy: " << startEnergy << " -> " << endEnergy
+		 << ", drift " << (endEnergy - startEnergy)/fabs(startEnergy) << endl;
+	cout << "Allocations: " << heapAllocations << " by the procs from the "
+		 << "heap in " << numSteps << " steps, arena "
+		 << stepArena.capacity() << " bytes, "
+		 << stepArena.outlived() << " blocks outlived their step" << endl;
+	if (sleeping) {
+		cout << "Awake: " << sleep.awake().size() << " of "
+			 << points.getSize() << " points, " << sleep.activeElements()
+			 << " of " << hyperedges.getSize() << " triangles stepped at the"
+			 << " last check" << endl;
+		sleep.reportSteps(cout);
+	}
+
+	if (native) {
+		// differences relative to the size of the mesh
+		double lo[2], hi[2];
+		for (int d = 0; d < 2; d++) {
+			lo[d] = numeric_limits<double>::infinity();
+			hi[d] = -lo[d];
+		}
+		for (auto v : mesh.v)
+			for (int d = 0; d < 2; d++) {
+				lo[d] = min<double>(lo[d], v[d]);
+				hi[d] = max<double>(hi[d], v[d]);
+			}
+		double size = hypot(hi[0]-lo[0], hi[1]-lo[1]);
+		double maxDiff = 0.0;
+		for (size_t i = 0; i < pointRefs.size(); i++) {
+			FloatField<2>::Value x = positionField.get(pointRefs[i]);
+			const FloatField<2>::Value& r = referencePosition[i];
+			maxDiff = max(maxDiff, hypot(x[0]-r[0], x[1]-r[1]));
+		}
+		cout << "Native: " << nativeTime/numSteps << " ms/step stepping, "
+			 << (ms - nativeTime)/numSteps << " ms/step writing the fields; "
+			 << "main " << referenceMs/numSteps << " ms/step, "
+			 << referenceMs/nativeTime << "x; positions within "
+			 << maxDiff/max(size, 1e-300) << " of the mesh size of main's"
+			 << endl;
+	}
+
+	// simit fuses the maps of a proc into one function, so a proc run is
+	// the finest unit the host can count
+	if (profiling) {
+		stepCounters.report(cout, native ? "native" : multigrid ? "linearize" :
+							implicit ? "implicit" : legacy ? "main_legacy" : "main",
+							hyperedges.getSize(), "triangle", numSteps);
+		if (multigrid)
+			solveCounters.report(cout, "solves", hyperedges.getSize(),
+								 "triangle", numSteps);
+	}
+	if (memoryReport) {
+		reportMemory("after stepping");
+		memory.fits(cout, pointRefs.size(), "point");
+	}
+	if (adaptive)
+		reportAdaptive();
+	if (multigrid)
+		reportSolves();
+	if (instances.size() > 1)
+		reportInstances();
+}
+
+bool Elastic2D::loadCoarse(const char * file_name) {
+
+	// parsed by loadObject, which fills the fine mesh members
+	simit::MeshVol fine;
+	vector<double> fineArea;
+	swap(mesh, fine);
+	swap(restArea, fineArea);
+	bool loaded = loadObject(file_name);
+	swap(mesh, coarseMesh);
+	swap(mesh, fine);
+	swap(restArea, fineArea);
+	return loaded;
+}
+
 bool Elastic2D::loadObject(const char * file_name) {
 
     //check if the file opens
     if ( !file_name ) {
         return false;
     }
+    if (MeshGenerator::isSpec(file_name))
+        return generateMesh(file_name);
+
+    // a valid binary cache skips parsing and the rest area pass
+    auto start = chrono::steady_clock::now();
+    MeshCache cache;
+    vector<double> unused;
+    if (cache.open(file_name, MeshCache::Triangles) &&
+        cache.read(mesh, unused, restArea)) {
+        cout << "Number of vertices loaded: " << mesh.v.size() << endl;
+        cout << "Number of edges loaded: " << mesh.edges.size() << endl;
+        cout << "Loaded "
+             << MeshCache::cachePath(file_name, MeshCache::Triangles) << " in "
+             << chrono::duration<double,milli>(
+                    chrono::steady_clock::now() - start).count()
+             << " ms" << endl;
+        return true;
+    }
+    // a cache with bad indices may have been copied out partly
+    mesh.v.clear();
+    mesh.edges.clear();
 
     // open file
     FILE *fp = fopen( file_name, "r" );
@@ -335,7 +1595,7 @@ bool Elastic2D::loadObject(const char * file_name) {
 
 	float x_temp, y_temp, z_temp;
 	int a,b,c;
-	char* type;
+	char type[256];
 	int faceCount = 0;
 	int EOFp;
 
@@ -358,12 +1618,26 @@ bool Elastic2D::loadObject(const char * file_name) {
  		}
 		EOFp = fscanf( fp, "%s", type ); 
  	}
-
+	fclose(fp);
  
 	cout << "Number of vertices loaded: " << mesh.v.size() << endl;
 	cout << "Number of edges loaded: " << mesh.edges.size() << endl;
 	cout << "Number of faces loaded: " << faceCount << endl;
 
+	// rest areas A_i in the xy plane, cached together with the parsed mesh
+	restArea.resize(faceCount);
+	for (int f = 0; f < faceCount; f++) {
+		std::array<double,3> pA = mesh.v[mesh.edges[3*f][0]];
+		std::array<double,3> pB = mesh.v[mesh.edges[3*f+1][0]];
+		std::array<double,3> pC = mesh.v[mesh.edges[3*f+2][0]];
+		restArea[f] = 0.5 * fabs((pB[0]-pA[0])*(pC[1]-pA[1]) -
+								 (pC[0]-pA[0])*(pB[1]-pA[1]));
+	}
+	if (!MeshCache::write(file_name, MeshCache::Triangles, mesh, vector<double>(),
+						  restArea))
+		cerr << "Unable to write "
+			 << MeshCache::cachePath(file_name, MeshCache::Triangles) << endl;
+
 
 	
 /*	//create T_i
@@ -399,3 +1673,40 @@ bool Elastic2D::loadObject(const char * file_name) {
 	return true;
 }
 
+bool Elastic2D::generateMesh(const char * spec) {
+
+	// triangles are stepped in the xy plane, where a lattice folds flat
+	auto start = chrono::steady_clock::now();
+	MeshGenerator generator(0);
+	if ((strncmp(spec, "grid:", 5) != 0) ||
+		!generator.generate(spec, gridStep, 1, mesh)) {
+		cerr << "Unable to generate " << spec << ", expected grid:NXxNY or"
+			 << " grid:N" << endl;
+		return false;
+	}
+	generator.restAreas(mesh, restArea);
+
+	cout << "Number of vertices generated: " << mesh.v.size() << endl;
+	cout << "Number of edges generated: " << mesh.edges.size() << endl;
+	cout << "Generated " << spec << " in "
+		 << chrono::duration<double,milli>(
+				chrono::steady_clock::now() - start).count()
+		 << " ms" << endl;
+	return true;
+}
+
+void Elastic2D::subdivide(int levels) {
+
+	auto start = chrono::steady_clock::now();
+	MeshGenerator generator(0);
+	generator.subdivide(levels, mesh);
+	generator.restAreas(mesh, restArea);
+
+	cout << "Number of vertices after " << levels << " subdivisions: "
+		 << mesh.v.size() << endl;
+	cout << "Number of edges after " << levels << " subdivisions: "
+		 << mesh.edges.size() << endl;
+	cout << "Subdivided in " << chrono::duration<double,milli>(
+									chrono::steady_clock::now() - start).count()
+		 << " ms" << endl;
+}
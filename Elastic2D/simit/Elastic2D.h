@@ -6,28 +6,228 @@
 #include "error.h"
 #include "function.h"
 #include "mesh.h"
+#include "FloatField.h"
+#include "MemoryReport.h"
+#include "NativeEngine.h"
+#include "PerfCounters.h"
+#include "SleepTracker.h"
+#include "StateExport.h"
+#include "Trajectory.h"
+#include "StepArena.h"
+#include "TwoLevelSolver.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <vector>
 #include <Eigen/Eigen>
 
+// Material and time step parameters of one simulated instance. A
+// parameter sweep replicates the mesh once per instance, see
+// Elastic2D::loadSweep.
+struct ElasticParams
+{
+    double alpha;	// St. Venant-Kirchhoff Lame parameters
+    double beta;
+    double h;		// time step
+};
+
+// Step counts of the adaptive integrator, see Elastic2D::adaptiveStep.
+struct AdaptiveStats
+{
+    int accepted;
+    int rejected;
+    double time;	// simulated time
+    double minH;
+    double maxH;
+};
+
+// Linear solves of the multigrid stepper, see Elastic2D::multigridStep.
+struct SolveStats
+{
+    int solves;			// one per Newton iteration
+    long iterations;	// CG iterations over all solves
+    double ms;			// wall time of the solves, coarse setup included
+};
+
 class Elastic2D
 {
 public:
     
     Elastic2D();
+	void setPrecision(Precision p) { precision = p; }
+	void setAdaptive(bool on) { adaptive = on; }
+	void setImplicit(bool on) { implicit = on; }
+	void setLegacy(bool on) { legacy = on; }
+	void setSlim(bool on) { slim = on; }
+	void setMultigrid(bool on, bool plain) { multigrid = on; plainCG = plain; }
+	void setSleeping(bool on) { sleeping = on; }
+	void setNative(bool on) { nativeEngine = on; }
+	void setProfiling(bool on) { profiling = on; }
+	void setMemoryReport(bool on) { memoryReport = on; }
+	void setExport(const std::string& name, int interval) {
+		exportName = name;
+		exportInterval = std::max(interval, 1);
+	}
+	void setRecord(const std::string& path, int interval) {
+		recordPath = path;
+		exportInterval = std::max(interval, 1);
+	}
+	void compile();
 	void load();
 	void step();
+	void bench(int numSteps);
+	void advance();
+	double adaptiveStep();
+	void reportAdaptive();
+	double systemEnergy();
+	double instanceEnergy(size_t instance);
+	void reportInstances();
+	// file_name may also be a MeshGenerator spec such as grid:100x100
 	bool loadObject(const char * file_name);
+	void subdivide(int levels);
+	bool loadCoarse(const char * file_name);
+	bool loadSweep(const char * file_name);
+
+	// Parameter updates between run() calls. These write fields and bound
+	// externs in place and never recompile the program.
+	void setParams(size_t instance, const ElasticParams& params);
+	bool setParameter(const std::string& name, double value);
     
 protected:
 
     simit::MeshVol mesh;   
+    std::vector<double> restArea;	// A_i per face, from loadObject
+    bool generateMesh(const char * spec);
+    Precision precision;
     simit::Set points;
     simit::Set hyperedges;
+    std::vector<ElasticParams> instances;	// empty means one default instance
+    std::vector<simit::ElementRef> pointRefs;		// mesh vertex x instance
+    std::vector<simit::ElementRef> hyperedgeRefs;	// mesh face x instance
     simit::Program program;
     simit::Function precomputation;
-    simit::Function timeStepper;
+    simit::Function timeStepper;	// main, implicit or main_legacy
+    StepArena stepArena;		// temporaries of timeStepper.run()
+    void runStep();
+    bool profiling;				// hardware counters in bench()
+    PerfCounters stepCounters;	// around timeStepper.run()
+    PerfCounters solveCounters;	// around the multigrid solves
+    void reportMemory(const std::string& phase);
+    bool memoryReport;			// after load, after init, end of bench()
+    MemoryReport memory;
+
+    // the triangles once and the positions every exportInterval steps in
+    // shared memory, for viewers in other processes, and to a trajectory
+    // file, for FrameRenderer
+    void exportState();
+    std::string exportName;		// empty means no export
+    int exportInterval;
+    std::unique_ptr<StateExport> exporter;
+    std::string recordPath;		// empty means no trajectory
+    std::unique_ptr<TrajectoryWriter> recorder;
+    std::vector<float> exportPositions;
+    uint64_t exportSteps;		// since load()
+    double exportTime;			// simulated, of the first instance
+
+    // --native: main stepped by NativeEngine instead of the program, with
+    // position and velocity written back to the fields after every step;
+    // bench() first runs main from the same state to validate it
+    void loadNative();
+    void nativeStep();
+    double referenceRun(int numSteps);
+    bool nativeEngine;
+    std::unique_ptr<NativeStepper> native;
+    double nativeTime;			// ms spent in native->step()
+    // handles of the fields the steppers and the energy report read or
+    // write, kept so that a step does not allocate them
+    FloatField<2> positionField;
+    FloatField<2> velocityField;
+    simit::FieldRef<bool> pinnedField;
+    FloatField<> massField;
+    FloatField<> energyField;
+    FloatField<> minEdgeField;
+    FloatField<6> dEnergyField;		// full HyperEdge only
+    std::vector<FloatField<2>::Value> referencePosition;
+    bool implicit;
+    bool legacy;	// step through the ∂W ∂ε ∂Dɸ chain instead of Dm⁻¹
+    bool slim;		// Elastic2DSlim.sim, no per-step scratch in HyperEdge
+    FloatExtern<2> gravity;
+    // a sweep keeps h per point and alpha, beta per triangle, a single
+    // instance binds them as the parameters extern, see compile()
+    bool perInstance;
+    FloatExtern<3> parameters;		// h, alpha, beta
+    double massPerUnitArea;
+
+    // --sleep, as in SpringSystem: every sleepInterval steps points that
+    // stayed calm for sleepChecks checks go to sleep, see settle(), and
+    // while any point sleeps main runs on compacted copies of the active
+    // triangles and the points they touch, rebuilt by compactSets() only
+    // when a point falls asleep or wakes. The full sets get the awake
+    // points' position and velocity and the active triangles' energy back
+    // after every run.
+    void settle();
+    void compactSets();
+    void bindSets(simit::Set& stepPoints, simit::Set& stepTriangles);
+    void scatter();
+    bool sleeping;
+    double sleepSpeed;			// NaN means automatic
+    int sleepChecks;
+    int stepCount;
+    SleepTracker sleep;
+    bool compacted;				// main bound to the awake sets
+    std::unique_ptr<simit::Set> awakePoints;
+    std::unique_ptr<simit::Set> awakeTriangles;	// (awakePoints x 3)
+    std::vector<simit::ElementRef> awakePointRefs;
+    std::vector<simit::ElementRef> awakeTriangleRefs;
+    std::vector<size_t> activePoints;	// awake set index -> full index
+    std::vector<size_t> activeTriangles;
+    std::vector<int> compactOf;		// full -> awake set index, or -1
+    FloatField<2> awakePosition;
+    FloatField<2> awakeVelocity;
+    FloatField<> awakeEnergy;
+
+    std::promise<void> initReady;	// fulfilled once init is compiled
+    std::future<void> initCompiled;
+    std::future<void> compiled;	// set by compile(), waited on in load()
+    double compileTime;
+    std::chrono::steady_clock::time_point startupBegin;
     int* localToGlobalMap;
+
+    // adaptive time stepping
+    void initAdaptive();
+    bool adaptive;
+    double h;			// step the next adaptiveStep() tries
+    double appliedH;		// step in the h field, NaN before the first
+    double stableH;		// CFL bound from the rest edge lengths
+    double lastEnergy;	// system energy after the last accepted step
+    AdaptiveStats adaptStats;
+    std::vector<FloatField<2>::Value> savedPosition;	// rollback state
+    std::vector<FloatField<2>::Value> savedVelocity;
+
+    // backward Euler with the Newton systems solved on the host, by CG
+    // preconditioned with a two-level cycle on a coarse mesh
+    void initMultigrid();
+    void multigridStep();
+    void fillHessian(size_t dofs, const std::vector<bool>& pin);
+    void reportSolves();
+    bool multigrid;
+    bool plainCG;		// the same solves without the preconditioner
+    simit::MeshVol coarseMesh;	// empty means decimate the mesh
+    TwoLevelSolver solver;
+    std::vector<Eigen::Matrix2d,
+                Eigen::aligned_allocator<Eigen::Matrix2d> > restInverse;
+    SolveStats solveStats;
+    // Newton system of multigridStep, kept between iterations and steps
+    std::vector<Eigen::Triplet<double> > hessianEntries;
+    TwoLevelSolver::Matrix hessian;
+    std::vector<int> hessianSlot;	// of each entry in the values of hessian
+    std::vector<bool> hessianPinned;	// pinned points of the slots
+    Eigen::VectorXd newtonGrad;
+    Eigen::VectorXd newtonStep;
+    Eigen::VectorXd newtonTrial;
     
 };
 
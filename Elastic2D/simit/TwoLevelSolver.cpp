@@ -0,0 +1,250 @@
+#include "TwoLevelSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <set>
+
+using namespace std;
+
+typedef Eigen::Triplet<double> Entry;
+
+TwoLevelSolver::TwoLevelSolver() : A(NULL), sweeps(2) {
+}
+
+// Barycentric coordinates of x in triangle (a, b, c) in the xy plane.
+static bool barycentric(const array<double,3>& a, const array<double,3>& b,
+                        const array<double,3>& c, const array<double,3>& x,
+                        double w[3]) {
+
+    double area = (b[0]-a[0])*(c[1]-a[1]) - (c[0]-a[0])*(b[1]-a[1]);
+    if (fabs(area) < 1e-300)
+        return false;
+    w[0] = ((b[0]-x[0])*(c[1]-x[1]) - (c[0]-x[0])*(b[1]-x[1])) / area;
+    w[1] = ((c[0]-x[0])*(a[1]-x[1]) - (a[0]-x[0])*(c[1]-x[1])) / area;
+    w[2] = 1.0 - w[0] - w[1];
+    return true;
+}
+
+void TwoLevelSolver::setMeshes(const simit::MeshVol& fine,
+                               const simit::MeshVol& coarse, size_t copies) {
+
+    size_t nf = fine.v.size();
+    size_t nc = coarse.v.size();
+    size_t nt = coarse.edges.size()/3;
+
+    // bucket the coarse triangles on a grid of about one triangle per cell
+    double lo[2] = { numeric_limits<double>::infinity(),
+                     numeric_limits<double>::infinity() };
+    double hi[2] = { -lo[0], -lo[1] };
+    for (const array<double,3>& v : coarse.v)
+        for (int d = 0; d < 2; d++) {
+            lo[d] = min(lo[d], v[d]);
+            hi[d] = max(hi[d], v[d]);
+        }
+    int cells = max(1, (int)sqrt((double)nt));
+    double size[2];
+    for (int d = 0; d < 2; d++)
+        size[d] = max(hi[d] - lo[d], 1e-12) / cells;
+    auto cellOf = [&](double x, int d) {
+        return min(cells-1, max(0, (int)floor((x - lo[d]) / size[d])));
+    };
+    vector<vector<int> > buckets(cells*cells);
+    for (size_t t = 0; t < nt; t++) {
+        int c0[2] = { cells, cells }, c1[2] = { -1, -1 };
+        for (int i = 0; i < 3; i++) {
+            const array<double,3>& v = coarse.v[coarse.edges[3*t+i][0]];
+            for (int d = 0; d < 2; d++) {
+                c0[d] = min(c0[d], cellOf(v[d], d));
+                c1[d] = max(c1[d], cellOf(v[d], d));
+            }
+        }
+        for (int i = c0[0]; i <= c1[0]; i++)
+            for (int j = c0[1]; j <= c1[1]; j++)
+                buckets[i*cells + j].push_back((int)t);
+    }
+
+    // each fine point takes the coarse triangle it lies deepest inside;
+    // points outside the coarse mesh take the nearest one, clamped
+    vector<Entry> entries;
+    vector<bool> used(nc, false);
+    for (size_t p = 0; p < nf; p++) {
+        const array<double,3>& x = fine.v[p];
+        const vector<int>& bucket = buckets[cellOf(x[0], 0)*cells +
+                                            cellOf(x[1], 1)];
+        int best = -1;
+        double bestScore = -numeric_limits<double>::infinity();
+        double bestW[3] = { 0.0, 0.0, 0.0 };
+        for (int pass = 0; (pass < 2) && (best < 0 || bestScore < -1e-9);
+             pass++) {
+            size_t count = pass ? nt : bucket.size();
+            for (size_t k = 0; k < count; k++) {
+                size_t t = pass ? k : bucket[k];
+                double w[3];
+                if (!barycentric(coarse.v[coarse.edges[3*t][0]],
+                                 coarse.v[coarse.edges[3*t+1][0]],
+                                 coarse.v[coarse.edges[3*t+2][0]], x, w))
+                    continue;
+                double score = min(w[0], min(w[1], w[2]));
+                if (score > bestScore) {
+                    best = (int)t;
+                    bestScore = score;
+                    copy(w, w+3, bestW);
+                }
+            }
+        }
+        if (best < 0)
+            continue;
+
+        double sum = 0.0;
+        for (int i = 0; i < 3; i++)
+            sum += (bestW[i] = max(bestW[i], 0.0));
+        for (int i = 0; i < 3; i++) {
+            int c = coarse.edges[3*best+i][0];
+            if (bestW[i] == 0.0)
+                continue;
+            used[c] = true;
+            for (size_t instance = 0; instance < copies; instance++)
+                for (int d = 0; d < 2; d++)
+                    entries.push_back(Entry(2*(instance*nf + p) + d,
+                                            2*(instance*nc + c) + d,
+                                            bestW[i]/sum));
+        }
+    }
+    P.resize(2*nf*copies, 2*nc*copies);
+    P.setFromTriplets(entries.begin(), entries.end());
+
+    // coarse points without fine support would leave P' A P singular
+    entries.clear();
+    for (size_t instance = 0; instance < copies; instance++)
+        for (size_t c = 0; c < nc; c++)
+            if (!used[c])
+                for (int d = 0; d < 2; d++)
+                    entries.push_back(Entry(2*(instance*nc + c) + d,
+                                            2*(instance*nc + c) + d, 1.0));
+    unsupported.resize(2*nc*copies, 2*nc*copies);
+    unsupported.setFromTriplets(entries.begin(), entries.end());
+}
+
+simit::MeshVol TwoLevelSolver::decimate(const simit::MeshVol& fine,
+                                        double cellSize) {
+
+    simit::MeshVol coarse;
+    map<pair<long,long>, int> clusters;
+    vector<int> clusterOf(fine.v.size());
+    vector<int> members;
+    for (size_t p = 0; p < fine.v.size(); p++) {
+        pair<long,long> cell((long)floor(fine.v[p][0] / cellSize),
+                             (long)floor(fine.v[p][1] / cellSize));
+        auto found = clusters.find(cell);
+        if (found == clusters.end()) {
+            found = clusters.insert(make_pair(cell, (int)coarse.v.size())).first;
+            coarse.v.push_back({{0.0, 0.0, 0.0}});
+            members.push_back(0);
+        }
+        int c = found->second;
+        clusterOf[p] = c;
+        for (int d = 0; d < 3; d++)
+            coarse.v[c][d] += fine.v[p][d];
+        members[c]++;
+    }
+    for (size_t c = 0; c < coarse.v.size(); c++)
+        for (int d = 0; d < 3; d++)
+            coarse.v[c][d] /= members[c];
+
+    set<array<int,3> > seen;
+    for (size_t f = 0; f < fine.edges.size()/3; f++) {
+        array<int,3> t;
+        for (int i = 0; i < 3; i++)
+            t[i] = clusterOf[fine.edges[3*f+i][0]];
+        if ((t[0] == t[1]) || (t[1] == t[2]) || (t[2] == t[0]))
+            continue;
+        array<int,3> key = t;
+        sort(key.begin(), key.end());
+        if (!seen.insert(key).second)
+            continue;
+        for (int i = 0; i < 3; i++)
+            coarse.edges.push_back({t[i], t[(i+1)%3]});
+    }
+    return coarse;
+}
+
+void TwoLevelSolver::setMatrix(const Matrix& A, bool plain) {
+
+    this->A = &A;
+    if (plain)
+        return;
+    AP = A * P;
+    coarseA = Matrix(P.transpose()) * AP;
+    coarseA += unsupported;
+    coarseSolver.compute(coarseA);
+}
+
+void TwoLevelSolver::sweep(const Vector& b, Vector& x, bool forward) const {
+
+    // A is symmetric, so column i lists the entries of row i
+    Eigen::Index n = A->cols();
+    for (Eigen::Index k = 0; k < n; k++) {
+        Eigen::Index i = forward ? k : n-1 - k;
+        double sum = b[i];
+        double diagonal = 0.0;
+        for (Matrix::InnerIterator it(*A, i); it; ++it) {
+            if (it.row() == i)
+                diagonal = it.value();
+            else
+                sum -= it.value() * x[it.row()];
+        }
+        x[i] = sum / diagonal;
+    }
+}
+
+void TwoLevelSolver::cycle(const Vector& r, Vector& z) {
+
+    z.setZero(r.size());
+    for (int s = 0; s < sweeps; s++)
+        sweep(r, z, true);
+    residual = r;
+    residual.noalias() -= (*A) * z;
+    coarseResidual.noalias() = P.transpose() * residual;
+    coarseCorrection = coarseSolver.solve(coarseResidual);
+    z.noalias() += P * coarseCorrection;
+    for (int s = 0; s < sweeps; s++)
+        sweep(r, z, false);
+}
+
+int TwoLevelSolver::solve(const Vector& b, Vector& x, double tol,
+                          int maxIterations, bool plain) {
+
+    // the vectors keep their storage from one solve to the next
+    Vector& r = cgResidual;
+    Vector& z = cgPreconditioned;
+    Vector& s = cgDirection;
+    Vector& As = cgProduct;
+    x.setZero(b.size());
+    r = b;
+    if (plain)
+        z = r;
+    else
+        cycle(r, z);
+    s = z;
+    double rz = r.dot(z);
+    double limit = tol * b.norm();
+
+    int iterations = 0;
+    while ((iterations < maxIterations) && (r.norm() > limit)) {
+        As.noalias() = (*A) * s;
+        double a = rz / s.dot(As);
+        x += a * s;
+        r -= a * As;
+        if (plain)
+            z = r;
+        else
+            cycle(r, z);
+        double rzNew = r.dot(z);
+        s *= rzNew / rz;
+        s += z;
+        rz = rzNew;
+        iterations++;
+    }
+    return iterations;
+}
@@ -0,0 +1,70 @@
+#ifndef _Elastic2D_TwoLevelSolver_h
+#define _Elastic2D_TwoLevelSolver_h
+
+#include "mesh.h"
+#include <Eigen/Eigen>
+#include <vector>
+
+/* Two-level geometric multigrid for the Newton systems of the implicit
+ * step, used as the preconditioner of a conjugate gradient solve.
+ *
+ * The coarse level is a second, coarser triangulation of the same domain.
+ * Every fine point is tied to the coarse triangle that holds it at rest by
+ * its barycentric weights, so P interpolates coarse displacements to the
+ * fine points and P' restricts fine residuals. The coarse operator P' A P
+ * is small enough to factor directly. Symmetric Gauss-Seidel sweeps around
+ * the coarse correction remove the high frequency error the coarse mesh
+ * cannot represent, and keep the cycle symmetric for CG. */
+class TwoLevelSolver
+{
+public:
+
+    typedef Eigen::SparseMatrix<double> Matrix;
+    typedef Eigen::VectorXd Vector;
+
+    TwoLevelSolver();
+
+    // Ties every vertex of fine to a triangle of coarse, both as loaded by
+    // Elastic2D (0-based, three edges per face, xy only), for each of
+    // copies instances stored one after the other.
+    void setMeshes(const simit::MeshVol& fine, const simit::MeshVol& coarse,
+                   size_t copies);
+
+    // A coarse mesh of fine, one vertex per occupied cell of a grid with the
+    // given cell size and one triangle per fine face that spans three cells.
+    static simit::MeshVol decimate(const simit::MeshVol& fine, double cellSize);
+
+    // Sets up the coarse operator for the following solves, unless they
+    // are all plain. A must be symmetric positive definite and stay alive
+    // until the next call.
+    void setMatrix(const Matrix& A, bool plain = false);
+
+    // Solves A x = b from x = 0 to a residual of tol |b|, with the two-level
+    // cycle as preconditioner unless plain. Returns the iterations taken.
+    int solve(const Vector& b, Vector& x, double tol, int maxIterations,
+              bool plain = false);
+
+    size_t coarsePoints() const { return P.cols()/2; }
+
+private:
+
+    void cycle(const Vector& r, Vector& z);
+    void sweep(const Vector& b, Vector& x, bool forward) const;
+
+    Matrix P;			// fine x coarse dofs, barycentric weights
+    Matrix unsupported;	// identity on coarse dofs no fine point uses
+    const Matrix* A;
+    Matrix AP;
+    Matrix coarseA;
+    Eigen::SimplicialLDLT<Matrix> coarseSolver;
+    Vector residual;	// scratch of cycle
+    Vector coarseResidual;
+    Vector coarseCorrection;
+    Vector cgResidual;	// scratch of solve
+    Vector cgPreconditioned;
+    Vector cgDirection;
+    Vector cgProduct;
+    int sweeps;			// Gauss-Seidel sweeps before and after
+};
+
+#endif
@@ -1,16 +1,175 @@
 #include "Elastic2D.h"
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
 
+using namespace std;
+
+/* Elastic2D [mesh] <backend> [options]
+ *   mesh           an OBJ file, or a planar grid generated in memory:
+ *                  grid:NXxNY (two triangles per cell) or grid:N for
+ *                  about N triangles
+ *   --subdivide L  split every triangle into four, L times
+ *   --float32      run the program and store its fields in float32; only
+ *                  the host's energy reports accumulate in double
+ *   --bench N      run N steps without the viewer and report timings
+ *   --adaptive     adapt h to the strain rate and energy error; with
+ *                  --bench, cover the simulated time of N fixed steps;
+ *                  not with --sweep, h is shared by the whole system
+ *   --implicit     step with backward Euler (Newton + CG) instead of the
+ *                  explicit update, use with a larger h, e.g. --set h=1e-2
+ *   --legacy       step with the original dPhi/dStrain/dEnergy kernels,
+ *                  to compare against the precomputed Dm^-1 path
+ *   --slim         keep only rest data per triangle (Elastic2DSlim.sim),
+ *                  not with --implicit or --legacy
+ *   --native       step main with the hand-written NativeEngine, not with
+ *                  --adaptive or the other steppers; with --bench, run main
+ *                  from the same state first and report both step times
+ *                  and the difference in positions
+ *   --multigrid    backward Euler with the Newton systems solved on the
+ *                  host by CG, preconditioned with a two-level cycle
+ *   --coarse FILE  coarse mesh of --multigrid, by default the mesh is
+ *                  decimated
+ *   --cg           the --multigrid solves without the preconditioner
+ *   --sleep        put settled points to sleep and step only the triangles
+ *                  with an awake point, in sets rebuilt when one sleeps
+ *                  or wakes; main only, not with --adaptive or --native
+ *   --counters     with --bench, report hardware counters (IPC, LLC and
+ *                  branch misses per triangle) of the step procs
+ *   --memory       report bytes per set, field and temporaries with the
+ *                  process RSS after load, after init and after --bench
+ *   --export NAME  publish the triangles once and the positions every 10
+ *                  steps as POSIX shared memory /NAME, see StateReader
+ *   --record FILE  write the triangles once and the positions every 10
+ *                  steps to the trajectory FILE, see FrameRenderer
+ *   --export-interval N  publish or record every N steps instead
+ *   --sweep FILE   batch one instance per line of FILE ("alpha beta h")
+ *                  into the same sets and report per-instance results
+ *   --set NAME=VAL set alpha, beta, h, massperunitarea or gravity without
+ *                  recompiling, or sleepspeed and sleepchecks of --sleep
+ */
 int main(int argc, char **argv) {
 
-        simit::init(argv[argc-1], sizeof(simit_float));
+        Precision precision = DoublePrecision;
+        int benchSteps = 0;
+        int subdivisions = 0;
+        bool adaptive = false;
+        bool implicit = false;
+        bool legacy = false;
+        bool slim = false;
+        bool multigrid = false;
+        bool native = false;
+        bool plainCG = false;
+        bool sleeping = false;
+        bool profiling = false;
+        bool memoryReport = false;
+        const char* exportName = NULL;
+        const char* recordPath = NULL;
+        int exportInterval = 10;
+        const char* coarse = NULL;
+        const char* sweep = NULL;
+        vector<char*> settings;
+        vector<char*> args;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--float32") == 0)
+                precision = SinglePrecision;
+            else if ((strcmp(argv[i], "--subdivide") == 0) && (i+1 < argc))
+                subdivisions = atoi(argv[++i]);
+            else if ((strcmp(argv[i], "--bench") == 0) && (i+1 < argc))
+                benchSteps = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--adaptive") == 0)
+                adaptive = true;
+            else if (strcmp(argv[i], "--implicit") == 0)
+                implicit = true;
+            else if (strcmp(argv[i], "--legacy") == 0)
+                legacy = true;
+            else if (strcmp(argv[i], "--slim") == 0)
+                slim = true;
+            else if (strcmp(argv[i], "--native") == 0)
+                native = true;
+            else if (strcmp(argv[i], "--multigrid") == 0)
+                multigrid = true;
+            else if (strcmp(argv[i], "--cg") == 0)
+                multigrid = plainCG = true;
+            else if (strcmp(argv[i], "--sleep") == 0)
+                sleeping = true;
+            else if (strcmp(argv[i], "--counters") == 0)
+                profiling = true;
+            else if (strcmp(argv[i], "--memory") == 0)
+                memoryReport = true;
+            else if ((strcmp(argv[i], "--export") == 0) && (i+1 < argc))
+                exportName = argv[++i];
+            else if ((strcmp(argv[i], "--record") == 0) && (i+1 < argc))
+                recordPath = argv[++i];
+            else if ((strcmp(argv[i], "--export-interval") == 0) &&
+                     (i+1 < argc))
+                exportInterval = atoi(argv[++i]);
+            else if ((strcmp(argv[i], "--coarse") == 0) && (i+1 < argc))
+                coarse = argv[++i];
+            else if ((strcmp(argv[i], "--sweep") == 0) && (i+1 < argc))
+                sweep = argv[++i];
+            else if ((strcmp(argv[i], "--set") == 0) && (i+1 < argc))
+                settings.push_back(argv[++i]);
+            else
+                args.push_back(argv[i]);
+        }
+        if (args.empty() || (slim && (implicit || legacy)) ||
+            (multigrid && (implicit || legacy || slim || adaptive)) ||
+            (native && (implicit || legacy || multigrid || adaptive)) ||
+            (sleeping && (implicit || legacy || multigrid || adaptive ||
+                          native)) ||
+            (adaptive && sweep)) {
+            std::cerr << "usage: " << argv[0]
+                      << " [mesh.obj | grid:NXxNY] <backend> [--subdivide L]"
+                      << " [--float32] [--bench N] [--adaptive]"
+                      << " [--implicit | --legacy | --slim |"
+                      << " --multigrid [--coarse FILE] [--cg]] [--native]"
+                      << " [--sleep]"
+                      << " [--counters] [--memory]"
+                      << " [--export NAME] [--record FILE]"
+                      << " [--export-interval N]"
+                      << " [--sweep FILE] [--set NAME=VAL]"
+                      << std::endl;
+            return 1;
+        }
+
+        simit::init(args.back(), floatBytes(precision));
         Elastic2D t;
-        if ((argc > 2) && (t.loadObject(argv[1]))) {
-	        t.load();
-    	    t.step();
-    	} else {
-			t.load();
-			t.step();
-		}
+        t.setPrecision(precision);
+        t.setAdaptive(adaptive);
+        t.setImplicit(implicit);
+        t.setLegacy(legacy);
+        t.setSlim(slim);
+        t.setMultigrid(multigrid, plainCG);
+        t.setNative(native);
+        t.setSleeping(sleeping);
+        t.setProfiling(profiling);
+        t.setMemoryReport(memoryReport);
+        if (exportName)
+            t.setExport(string("/") + exportName, exportInterval);
+        if (recordPath)
+            t.setRecord(recordPath, exportInterval);
+        if (sweep && !t.loadSweep(sweep))
+            return 1;
+        for (char* setting : settings) {
+            char* value = strchr(setting, '=');
+            if (!value)
+                return 1;
+            *value++ = '\0';
+            if (!t.setParameter(setting, atof(value)))
+                return 1;
+        }
+        t.compile();
+        if ((args.size() > 1) && !t.loadObject(args[0]))
+            return 1;
+        if (subdivisions > 0)
+            t.subdivide(subdivisions);
+        if (coarse && !t.loadCoarse(coarse))
+            return 1;
+        t.load();
+        if (benchSteps > 0)
+            t.bench(benchSteps);
+        else
+            t.step();
     
 }
-
@@ -0,0 +1,223 @@
+#include "Raster.h"
+#include "Trajectory.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <errno.h>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/* FrameRenderer <trajectory> <outdir> [options]
+ *
+ * Renders the frames a SpringSystem or Elastic2D run saved with --record
+ * to <outdir>/frame_NNNNNN.png, without a display or GL: springs are drawn
+ * as gray lines, triangles filled light gray with dark edges. All frames
+ * share one view, fitted to every point they contain, so the images line
+ * up as a movie. Frames are rendered on all cores at once, each thread
+ * with its own image and compression buffers.
+ *
+ * --size WxH      image size in pixels, 1024x768 by default
+ * --every N       render every Nth saved frame
+ * --threads T     render on T threads instead of one per hardware thread
+ * --yaw DEG       turn 3D runs about the vertical axis before projecting
+ * --pitch DEG     then tilt them about the horizontal axis
+ */
+
+// Rotated and projected onto the image plane, before fitting.
+struct View
+{
+    double cy, sy, cp, sp;
+    int dims;
+
+    void project(const float* p, double& u, double& v) const {
+        if (dims < 3) {
+            u = p[0];
+            v = p[1];
+            return;
+        }
+        double x = cy*p[0] + sy*p[2];
+        double z = -sy*p[0] + cy*p[2];
+        u = x;
+        v = cp*p[1] - sp*z;
+    }
+};
+
+int main(int argc, char **argv) {
+
+    const char* usage = " <trajectory> <outdir> [--size WxH] [--every N]"
+                        " [--threads T] [--yaw DEG] [--pitch DEG]";
+    if (argc < 3) {
+        cerr << "usage: " << argv[0] << usage << endl;
+        return 1;
+    }
+    string path = argv[1];
+    string outdir = argv[2];
+    int width = 1024, height = 768;
+    size_t every = 1;
+    int threads = 0;
+    double yaw = 0.0, pitch = 0.0;
+    for (int arg = 3; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "--size") && (arg + 1 < argc)) {
+            if ((sscanf(argv[++arg], "%dx%d", &width, &height) != 2) ||
+                (width < 1) || (height < 1)) {
+                cerr << "bad --size " << argv[arg] << endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[arg], "--every") && (arg + 1 < argc))
+            every = max(atol(argv[++arg]), 1L);
+        else if (!strcmp(argv[arg], "--threads") && (arg + 1 < argc))
+            threads = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "--yaw") && (arg + 1 < argc))
+            yaw = atof(argv[++arg]);
+        else if (!strcmp(argv[arg], "--pitch") && (arg + 1 < argc))
+            pitch = atof(argv[++arg]);
+        else {
+            cerr << "usage: " << argv[0] << usage << endl;
+            return 1;
+        }
+    }
+
+    TrajectoryReader trajectory;
+    if (!trajectory.open(path)) {
+        cerr << "cannot read trajectory " << path << endl;
+        return 1;
+    }
+    int dims = trajectory.dims();
+    int arity = trajectory.arity();
+    size_t points = trajectory.points();
+    size_t elements = trajectory.elements();
+    const int* connectivity = trajectory.connectivity();
+    if ((dims < 2) || ((arity != 2) && (arity != 3))) {
+        cerr << path << ": cannot draw elements of " << arity << " points in "
+             << dims << " dimensions" << endl;
+        return 1;
+    }
+    for (size_t i = 0; i < elements*arity; i++)
+        if ((connectivity[i] < 0) || ((size_t)connectivity[i] >= points)) {
+            cerr << path << ": element " << i/arity << " refers to point "
+                 << connectivity[i] << " of " << points << endl;
+            return 1;
+        }
+    size_t count = (trajectory.frames() + every - 1) / every;
+    if (count == 0) {
+        cerr << path << ": no frames" << endl;
+        return 1;
+    }
+    if ((mkdir(outdir.c_str(), 0755) != 0) && (errno != EEXIST)) {
+        perror(outdir.c_str());
+        return 1;
+    }
+
+    typedef chrono::steady_clock Clock;
+    auto begin = Clock::now();
+    WorkerPool pool(threads);
+    int workers = pool.size();
+
+    const double radians = M_PI / 180.0;
+    View view = { cos(yaw*radians), sin(yaw*radians), cos(pitch*radians),
+                  sin(pitch*radians), dims };
+
+    // the bounds of every rendered frame, per worker and then merged
+    vector<double> bounds(4*workers);
+    for (int w = 0; w < workers; w++) {
+        bounds[4*w] = bounds[4*w+1] = HUGE_VAL;
+        bounds[4*w+2] = bounds[4*w+3] = -HUGE_VAL;
+    }
+    auto fit = [&](int worker, size_t first, size_t last) {
+        double* b = &bounds[4*worker];
+        for (size_t f = first; f < last; f++) {
+            const float* p = trajectory.positions(f*every);
+            for (size_t i = 0; i < points; i++) {
+                double u, v;
+                view.project(p + i*dims, u, v);
+                if (!std::isfinite(u) || !std::isfinite(v))
+                    continue;
+                b[0] = min(b[0], u); b[1] = min(b[1], v);
+                b[2] = max(b[2], u); b[3] = max(b[3], v);
+            }
+        }
+    };
+    pool.run(count, fit);
+    double lo[2] = { HUGE_VAL, HUGE_VAL }, hi[2] = { -HUGE_VAL, -HUGE_VAL };
+    for (int w = 0; w < workers; w++)
+        for (int d = 0; d < 2; d++) {
+            lo[d] = min(lo[d], bounds[4*w+d]);
+            hi[d] = max(hi[d], bounds[4*w+2+d]);
+        }
+    if (lo[0] > hi[0]) {
+        cerr << path << ": no finite positions" << endl;
+        return 1;
+    }
+    // same scale on both axes, with a 5% margin
+    double span = max(max((hi[0]-lo[0]) / width, (hi[1]-lo[1]) / height),
+                      1e-12);
+    double scale = 0.9 / span;
+    double centre[2] = { 0.5*(lo[0]+hi[0]), 0.5*(lo[1]+hi[1]) };
+    double fitTime = chrono::duration<double>(Clock::now() - begin).count();
+
+    vector<unique_ptr<Raster> > rasters(workers);
+    vector<vector<double> > screens(workers);
+    atomic<size_t> written(0), failed(0);
+    auto render = [&](int worker, size_t first, size_t last) {
+        if (!rasters[worker])
+            rasters[worker].reset(new Raster(width, height));
+        Raster& raster = *rasters[worker];
+        vector<double>& screen = screens[worker];
+        screen.resize(2*points);
+        char name[32];
+        for (size_t f = first; f < last; f++) {
+            const float* p = trajectory.positions(f*every);
+            for (size_t i = 0; i < points; i++) {
+                double u, v;
+                view.project(p + i*dims, u, v);
+                screen[2*i] = 0.5*width + (u - centre[0])*scale;
+                screen[2*i+1] = 0.5*height - (v - centre[1])*scale;
+            }
+
+            raster.clear();
+            for (size_t e = 0; e < elements; e++) {
+                const int* c = connectivity + e*arity;
+                if (arity == 2) {
+                    raster.line(screen[2*c[0]], screen[2*c[0]+1],
+                                screen[2*c[1]], screen[2*c[1]+1], 96);
+                    continue;
+                }
+                double x[3], y[3];
+                for (int i = 0; i < 3; i++) {
+                    x[i] = screen[2*c[i]];
+                    y[i] = screen[2*c[i]+1];
+                }
+                raster.triangle(x, y, 208);
+                for (int i = 0; i < 3; i++)
+                    raster.line(x[i], y[i], x[(i+1)%3], y[(i+1)%3], 64);
+            }
+
+            snprintf(name, sizeof(name), "/frame_%06zu.png", f);
+            if (raster.writePng(outdir + name))
+                written++;
+            else
+                failed++;
+        }
+    };
+    pool.run(count, render);
+
+    double total = chrono::duration<double>(Clock::now() - begin).count();
+    cout << "Rendered " << written << " of " << trajectory.frames()
+         << " frames (" << points << " points, " << elements << " elements) at "
+         << width << "x" << height << " to " << outdir << " on " << workers
+         << " threads in " << total << " s, " << written/(total - fitTime)
+         << " frames/s; fitting the view took " << fitTime << " s" << endl;
+    if (failed) {
+        cerr << failed << " frames could not be written to " << outdir << endl;
+        return 1;
+    }
+    return 0;
+}
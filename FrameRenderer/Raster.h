@@ -0,0 +1,48 @@
+#ifndef _FrameRenderer_Raster_h
+#define _FrameRenderer_Raster_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* An 8-bit grayscale image drawn on the CPU, and its PNG encoding.
+ *
+ * Shapes are drawn by keeping the darker of the pixel and their shade, so
+ * the drawing order does not matter and overlapping springs darken only
+ * up to their shade. Everything is clipped to the image. The buffers are
+ * kept between frames, so one Raster per thread renders a whole run
+ * without allocating. */
+class Raster
+{
+public:
+
+    Raster(int width, int height);
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    void clear(uint8_t shade = 255);
+
+    // Coordinates in pixels, y down.
+    void line(double x0, double y0, double x1, double y1, uint8_t shade);
+    void triangle(const double x[3], const double y[3], uint8_t shade);
+
+    // Writes the image as a PNG file, false on an I/O error.
+    bool writePng(const std::string& path);
+
+private:
+
+    void darken(int x, int y, uint8_t shade) {
+        uint8_t& p = pixels[(size_t)y*w + x];
+        if (shade < p)
+            p = shade;
+    }
+
+    int w, h;
+    std::vector<uint8_t> pixels;
+    std::vector<uint8_t> rows;		// filter byte and pixels per row
+    std::vector<uint8_t> packed;	// deflated rows
+    std::vector<uint8_t> file;
+};
+
+#endif
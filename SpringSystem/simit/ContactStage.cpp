@@ -0,0 +1,521 @@
+#include "ContactStage.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+typedef ContactStage::Vec3 Vec3;
+
+static inline Vec3 sub(const Vec3& a, const Vec3& b) {
+    return {{a[0]-b[0], a[1]-b[1], a[2]-b[2]}};
+}
+
+static inline Vec3 madd(const Vec3& a, double s, const Vec3& b) {
+    return {{a[0]+s*b[0], a[1]+s*b[1], a[2]+s*b[2]}};
+}
+
+static inline double dot(const Vec3& a, const Vec3& b) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+static inline double clamp01(double x) {
+    return min(max(x, 0.0), 1.0);
+}
+
+/* Closest point to p on triangle abc, with its barycentric weights
+ * (Ericson, Real-Time Collision Detection, 5.1.5). */
+static Vec3 closestOnTriangle(const Vec3& p, const Vec3& a, const Vec3& b,
+                              const Vec3& c, double w[3]) {
+
+    Vec3 ab = sub(b, a), ac = sub(c, a), ap = sub(p, a);
+    double d1 = dot(ab, ap), d2 = dot(ac, ap);
+    if (d1 <= 0.0 && d2 <= 0.0) {
+        w[0] = 1.0; w[1] = 0.0; w[2] = 0.0;
+        return a;
+    }
+    Vec3 bp = sub(p, b);
+    double d3 = dot(ab, bp), d4 = dot(ac, bp);
+    if (d3 >= 0.0 && d4 <= d3) {
+        w[0] = 0.0; w[1] = 1.0; w[2] = 0.0;
+        return b;
+    }
+    double vc = d1*d4 - d3*d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {
+        double v = d1/(d1 - d3);
+        w[0] = 1.0 - v; w[1] = v; w[2] = 0.0;
+        return madd(a, v, ab);
+    }
+    Vec3 cp = sub(p, c);
+    double d5 = dot(ab, cp), d6 = dot(ac, cp);
+    if (d6 >= 0.0 && d5 <= d6) {
+        w[0] = 0.0; w[1] = 0.0; w[2] = 1.0;
+        return c;
+    }
+    double vb = d5*d2 - d1*d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {
+        double t = d2/(d2 - d6);
+        w[0] = 1.0 - t; w[1] = 0.0; w[2] = t;
+        return madd(a, t, ac);
+    }
+    double va = d3*d6 - d5*d4;
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) {
+        double t = (d4 - d3)/((d4 - d3) + (d5 - d6));
+        w[0] = 0.0; w[1] = 1.0 - t; w[2] = t;
+        return madd(b, t, sub(c, b));
+    }
+    double denom = 1.0/(va + vb + vc);
+    double v = vb*denom, t = vc*denom;
+    w[0] = 1.0 - v - t; w[1] = v; w[2] = t;
+    return madd(madd(a, v, ab), t, ac);
+}
+
+/* Parameters s, t of the closest points p1 + s(q1-p1) and p2 + t(q2-p2)
+ * of two segments (Ericson 5.1.9). */
+static void closestOnSegments(const Vec3& p1, const Vec3& q1,
+                              const Vec3& p2, const Vec3& q2,
+                              double& s, double& t) {
+
+    const double eps = 1e-20;
+    Vec3 d1 = sub(q1, p1), d2 = sub(q2, p2), r = sub(p1, p2);
+    double a = dot(d1, d1), e = dot(d2, d2), f = dot(d2, r);
+    if (a <= eps && e <= eps) {
+        s = t = 0.0;
+        return;
+    }
+    if (a <= eps) {
+        s = 0.0;
+        t = clamp01(f/e);
+        return;
+    }
+    double c = dot(d1, r);
+    if (e <= eps) {
+        t = 0.0;
+        s = clamp01(-c/a);
+        return;
+    }
+    double b = dot(d1, d2);
+    double denom = a*e - b*b;
+    s = (denom > 0.0) ? clamp01((b*f - c*e)/denom) : 0.0;
+    t = (b*s + f)/e;
+    if (t < 0.0) {
+        t = 0.0;
+        s = clamp01(-c/a);
+    } else if (t > 1.0) {
+        t = 1.0;
+        s = clamp01((b - c)/a);
+    }
+}
+
+/* Grid */
+
+void ContactStage::Grid::resize(size_t entries, int workers) {
+
+    size_t n = 1024;
+    while (n < entries)
+        n *= 2;
+    mask = (uint32_t)(n - 1);
+    start.assign(n + 1, 0);
+    items.resize(entries);
+    counts.assign(workers, vector<uint32_t>(n, 0));
+    totals.assign(workers, 0);
+}
+
+void ContactStage::Grid::clear(WorkerPool& pool) {
+
+    auto zero = [this](int, size_t begin, size_t end) {
+        for (size_t w = 0; w < counts.size(); w++)
+            std::fill(counts[w].begin() + begin, counts[w].begin() + end, 0);
+    };
+    pool.run(buckets(), zero);
+}
+
+size_t ContactStage::Grid::prefix(WorkerPool& pool) {
+
+    // counts become each worker's insert cursor: bucket by bucket, and
+    // within a bucket worker by worker. Workers scan their own range of
+    // buckets twice, around a scan of the per-range totals.
+    auto sum = [this](int worker, size_t begin, size_t end) {
+        size_t total = 0;
+        for (size_t b = begin; b < end; b++)
+            for (size_t w = 0; w < counts.size(); w++)
+                total += counts[w][b];
+        totals[worker] = total;
+    };
+    auto scan = [this](int worker, size_t begin, size_t end) {
+        size_t offset = 0;
+        for (int w = 0; w < worker; w++)
+            offset += totals[w];
+        for (size_t b = begin; b < end; b++) {
+            start[b] = (uint32_t)offset;
+            for (size_t w = 0; w < counts.size(); w++) {
+                uint32_t c = counts[w][b];
+                counts[w][b] = (uint32_t)offset;
+                offset += c;
+            }
+        }
+    };
+    size_t n = buckets();
+    for (size_t w = 0; w < totals.size(); w++)
+        totals[w] = 0;
+    pool.run(n, sum);
+    size_t total = 0;
+    for (size_t w = 0; w < totals.size(); w++)
+        total += totals[w];
+    pool.run(n, scan);
+    start[n] = (uint32_t)total;
+    if (total > items.size())
+        items.resize(total);
+    return total;
+}
+
+/* ContactStage */
+
+ContactStage::ContactStage(int threads) : pool(threads), edgeLength(0.0),
+    invCellSize(1.0), skin(0.0), numPoints(0), built(false),
+    numCandidates(0), numContacts(0), numRebuilds(0), counting(false) {
+
+    params.stiffness = 1e4;
+    params.thickness = 0.0;
+    params.ground = -numeric_limits<double>::infinity();
+}
+
+void ContactStage::setMesh(const simit::MeshVol& mesh, double length) {
+
+    numPoints = mesh.v.size();
+    edgeLength = length;
+
+    triangles.clear();
+    edges.clear();
+    for (size_t i = 0; i + 2 < mesh.edges.size(); i += 3) {
+        std::array<int,3> t = {{mesh.edges[i][0]-1, mesh.edges[i+1][0]-1,
+                                mesh.edges[i+2][0]-1}};
+        triangles.push_back(t);
+        for (int j = 0; j < 3; j++) {
+            int a = t[j], b = t[(j+1)%3];
+            edges.push_back({{min(a,b), max(a,b)}});
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+    // a primitive no wider than a cell overlaps 4 cells on average and at
+    // most 2x2x2; larger ones grow the grid once in prefix()
+    pointIds.resize(numPoints);
+    for (size_t i = 0; i < numPoints; i++)
+        pointIds[i][0] = (int)i;
+    pointGrid.resize(numPoints, pool.size());
+    edgeGrid.resize(4*edges.size(), pool.size());
+    primLo.resize(max(triangles.size(), edges.size()));
+    primHi.resize(max(triangles.size(), edges.size()));
+    workerForce.assign(pool.size(), vector<Vec3>(numPoints));
+    workerCandidates.assign(pool.size(), 0);
+    workerContacts.assign(pool.size(), 0);
+    workerMoved.assign(pool.size(), 0);
+    builtX.resize(numPoints);
+    built = false;
+}
+
+ContactStage::Cell ContactStage::cellOf(const Vec3& x) const {
+
+    const double limit = 1 << 30;
+    Cell c;
+    for (int i = 0; i < 3; i++)
+        c[i] = (int)floor(min(max(x[i]*invCellSize, -limit), limit));
+    return c;
+}
+
+uint32_t ContactStage::bucketOf(const Cell& c, uint32_t mask) const {
+
+    return ((uint32_t)c[0]*73856093u ^ (uint32_t)c[1]*19349663u ^
+            (uint32_t)c[2]*83492791u) & mask;
+}
+
+// Cells packed 21 bits per axis. Far apart cells can share a key, the
+// bounding box tests after every key match reject those.
+uint64_t ContactStage::keyOf(const Cell& c) {
+
+    const uint64_t m = (1 << 21) - 1;
+    return (((uint64_t)c[0] & m) << 42) | (((uint64_t)c[1] & m) << 21) |
+           ((uint64_t)c[2] & m);
+}
+
+template <size_t n>
+void ContactStage::fill(Grid& grid, const vector<Vec3>& x,
+                        const vector<std::array<int,n> >& prims,
+                        double pad) {
+
+    auto count = [&](int worker, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            Vec3 lo = x[prims[i][0]], hi = lo;
+            for (size_t j = 1; j < n; j++)
+                for (int k = 0; k < 3; k++) {
+                    lo[k] = min(lo[k], x[prims[i][j]][k]);
+                    hi[k] = max(hi[k], x[prims[i][j]][k]);
+                }
+            primLo[i] = cellOf({{lo[0]-pad, lo[1]-pad, lo[2]-pad}});
+            primHi[i] = cellOf({{hi[0]+pad, hi[1]+pad, hi[2]+pad}});
+            Cell c;
+            for (c[0] = primLo[i][0]; c[0] <= primHi[i][0]; c[0]++)
+            for (c[1] = primLo[i][1]; c[1] <= primHi[i][1]; c[1]++)
+            for (c[2] = primLo[i][2]; c[2] <= primHi[i][2]; c[2]++)
+                grid.count(worker, bucketOf(c, grid.mask));
+        }
+    };
+    auto insert = [&](int worker, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            float box[6];
+            for (int k = 0; k < 3; k++) {
+                box[k] = box[k+3] = (float)x[prims[i][0]][k];
+                for (size_t j = 1; j < n; j++) {
+                    box[k] = min(box[k], (float)x[prims[i][j]][k]);
+                    box[k+3] = max(box[k+3], (float)x[prims[i][j]][k]);
+                }
+                box[k] -= (float)pad;
+                box[k+3] += (float)pad;
+            }
+            Cell c;
+            for (c[0] = primLo[i][0]; c[0] <= primHi[i][0]; c[0]++)
+            for (c[1] = primLo[i][1]; c[1] <= primHi[i][1]; c[1]++)
+            for (c[2] = primLo[i][2]; c[2] <= primHi[i][2]; c[2]++) {
+                Entry& e = grid.insert(worker, bucketOf(c, grid.mask));
+                e.id = (uint32_t)i;
+                e.key = keyOf(c);
+                e.corner = ((c[0] == primLo[i][0]) ? 1 : 0) |
+                           ((c[1] == primLo[i][1]) ? 2 : 0) |
+                           ((c[2] == primLo[i][2]) ? 4 : 0);
+                copy(box, box + 6, e.box);
+            }
+        }
+    };
+    grid.clear(pool);
+    pool.run(prims.size(), count);
+    grid.prefix(pool);
+    pool.run(prims.size(), insert);
+}
+
+void ContactStage::push(int worker, int p, const Vec3& f, double weight) {
+
+    Vec3& acc = workerForce[worker][p];
+    acc[0] += weight*f[0];
+    acc[1] += weight*f[1];
+    acc[2] += weight*f[2];
+}
+
+void ContactStage::pointTriangle(const vector<Vec3>& x, int worker,
+                                 size_t begin, size_t end) {
+
+    // the hash holds the points where they were built, up to half a skin
+    // from where they are now
+    const double thickness = params.thickness;
+    const double reach = thickness + 0.5*skin;
+    for (size_t t = begin; t < end; t++) {
+        const std::array<int,3>& tri = triangles[t];
+        const Vec3& a = x[tri[0]];
+        const Vec3& b = x[tri[1]];
+        const Vec3& c = x[tri[2]];
+        Vec3 lo, hi;
+        for (int k = 0; k < 3; k++) {
+            lo[k] = min(a[k], min(b[k], c[k])) - reach;
+            hi[k] = max(a[k], max(b[k], c[k])) + reach;
+        }
+        Cell clo = cellOf(lo), chi = cellOf(hi), cell;
+        for (cell[0] = clo[0]; cell[0] <= chi[0]; cell[0]++)
+        for (cell[1] = clo[1]; cell[1] <= chi[1]; cell[1]++)
+        for (cell[2] = clo[2]; cell[2] <= chi[2]; cell[2]++) {
+            uint64_t key = keyOf(cell);
+            uint32_t bucket = bucketOf(cell, pointGrid.mask);
+            for (uint32_t k = pointGrid.start[bucket];
+                 k < pointGrid.start[bucket+1]; k++) {
+                const Entry& e = pointGrid.items[k];
+                // the bucket may also hold other cells
+                if (e.key != key ||
+                    e.box[0] < lo[0] || e.box[1] < lo[1] || e.box[2] < lo[2] ||
+                    e.box[0] > hi[0] || e.box[1] > hi[1] || e.box[2] > hi[2])
+                    continue;
+                int p = (int)e.id;
+                if (p == tri[0] || p == tri[1] || p == tri[2])
+                    continue;
+                workerCandidates[worker]++;
+                double w[3];
+                Vec3 q = closestOnTriangle(x[p], a, b, c, w);
+                Vec3 n = sub(x[p], q);
+                double d = sqrt(dot(n, n));
+                if (d >= thickness || d <= 0.0)
+                    continue;
+                workerContacts[worker]++;
+                double s = params.stiffness*(thickness - d)/d;
+                Vec3 f = {{s*n[0], s*n[1], s*n[2]}};
+                push(worker, p, f, 1.0);
+                for (int i = 0; i < 3; i++)
+                    push(worker, tri[i], f, -w[i]);
+            }
+        }
+    }
+}
+
+void ContactStage::edgeEdge(const vector<Vec3>& x, int worker,
+                            size_t begin, size_t end) {
+
+    const double thickness = params.thickness;
+    for (size_t b = begin; b < end; b++) {
+        for (uint32_t i = edgeGrid.start[b]; i < edgeGrid.start[b+1]; i++) {
+            const Entry& a = edgeGrid.items[i];
+            for (uint32_t j = i + 1; j < edgeGrid.start[b+1]; j++) {
+                const Entry& o = edgeGrid.items[j];
+                // a pair is tested once, in the cell at the upper corner
+                // of its two range minima: there every axis starts the
+                // range of one of the two
+                if (((a.corner | o.corner) != 7) || o.key != a.key ||
+                    a.box[0] > o.box[3] || o.box[0] > a.box[3] ||
+                    a.box[1] > o.box[4] || o.box[1] > a.box[4] ||
+                    a.box[2] > o.box[5] || o.box[2] > a.box[5])
+                    continue;
+                const std::array<int,2>& e1 = edges[a.id];
+                const std::array<int,2>& e2 = edges[o.id];
+                if (e1[0] == e2[0] || e1[0] == e2[1] ||
+                    e1[1] == e2[0] || e1[1] == e2[1])
+                    continue;
+                workerCandidates[worker]++;
+                double s, t;
+                closestOnSegments(x[e1[0]], x[e1[1]], x[e2[0]], x[e2[1]],
+                                  s, t);
+                Vec3 c1 = madd(x[e1[0]], s, sub(x[e1[1]], x[e1[0]]));
+                Vec3 c2 = madd(x[e2[0]], t, sub(x[e2[1]], x[e2[0]]));
+                Vec3 n = sub(c1, c2);
+                double d = sqrt(dot(n, n));
+                if (d >= thickness || d <= 0.0)
+                    continue;
+                workerContacts[worker]++;
+                double ks = params.stiffness*(thickness - d)/d;
+                Vec3 f = {{ks*n[0], ks*n[1], ks*n[2]}};
+                push(worker, e1[0], f, 1.0 - s);
+                push(worker, e1[1], f, s);
+                push(worker, e2[0], f, -(1.0 - t));
+                push(worker, e2[1], f, -t);
+            }
+        }
+    }
+}
+
+bool ContactStage::moved(const vector<Vec3>& x) {
+
+    const double limit = 0.25*skin*skin;
+    auto check = [&](int worker, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            Vec3 d = sub(x[i], builtX[i]);
+            if (dot(d, d) > limit) {
+                workerMoved[worker] = 1;
+                return;
+            }
+        }
+    };
+    std::fill(workerMoved.begin(), workerMoved.end(), 0);
+    pool.run(numPoints, check);
+    for (char m : workerMoved)
+        if (m)
+            return true;
+    return false;
+}
+
+void ContactStage::apply(const vector<Vec3>& x, vector<Vec3>& f) {
+
+    // each worker sums into its own buffer, the ground acts per point
+    auto ground = [&](int, size_t begin, size_t end) {
+        for (size_t w = 0; w < workerForce.size(); w++)
+            for (size_t i = begin; i < end; i++)
+                workerForce[w][i] = {{0.0, 0.0, 0.0}};
+        for (size_t i = begin; i < end; i++)
+            if (x[i][1] < params.ground)
+                workerForce[0][i][1] =
+                    params.stiffness*(params.ground - x[i][1]);
+    };
+    auto triangleStage = [&](int worker, size_t begin, size_t end) {
+        pointTriangle(x, worker, begin, end);
+    };
+    auto edgeStage = [&](int worker, size_t begin, size_t end) {
+        edgeEdge(x, worker, begin, end);
+    };
+    auto reduce = [&](int, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            Vec3 sum = workerForce[0][i];
+            for (size_t w = 1; w < workerForce.size(); w++)
+                sum = madd(sum, 1.0, workerForce[w][i]);
+            f[i] = sum;
+        }
+    };
+
+    // worker w > 0 counts one index of these each, around all stages
+    auto startCounting = [&](int worker, size_t, size_t) {
+        if (worker > 0)
+            workerCounters[worker]->start();
+    };
+    auto stopCounting = [&](int worker, size_t, size_t) {
+        if (worker > 0)
+            workerCounters[worker]->stop();
+    };
+
+    std::fill(workerCandidates.begin(), workerCandidates.end(), 0);
+    std::fill(workerContacts.begin(), workerContacts.end(), 0);
+    if (counting)
+        pool.run(pool.size(), startCounting);
+    pool.run(numPoints, ground);
+    if (params.thickness > 0.0) {
+        // a point-triangle pair closer than thickness lies in the
+        // triangle's box padded by thickness, an edge-edge pair in the
+        // overlap of both boxes padded by half of it; with every point
+        // less than half a skin from where the hashes were built, the
+        // same holds for the built positions with the skin added
+        if (!built || moved(x)) {
+            skin = params.thickness;
+            invCellSize = 1.0/max(edgeLength + params.thickness + skin, 1e-12);
+            fill(pointGrid, x, pointIds, 0.0);
+            fill(edgeGrid, x, edges, 0.5*(params.thickness + skin));
+            auto keep = [&](int, size_t begin, size_t end) {
+                std::copy(x.begin() + begin, x.begin() + end,
+                          builtX.begin() + begin);
+            };
+            pool.run(numPoints, keep);
+            built = true;
+            numRebuilds++;
+        }
+        pool.run(triangles.size(), triangleStage);
+        pool.run(edgeGrid.buckets(), edgeStage);
+    }
+    pool.run(numPoints, reduce);
+    if (counting)
+        pool.run(pool.size(), stopCounting);
+
+    numCandidates = 0;
+    numContacts = 0;
+    for (int w = 0; w < pool.size(); w++) {
+        numCandidates += workerCandidates[w];
+        numContacts += workerContacts[w];
+    }
+}
+
+void ContactStage::openCounters() {
+
+    // perf counters count the thread that opens them
+    workerCounters.resize(pool.size());
+    auto open = [&](int worker, size_t, size_t) {
+        if (worker == 0)
+            return;
+        workerCounters[worker].reset(new PerfCounters());
+        workerCounters[worker]->open();
+    };
+    pool.run(pool.size(), open);
+    counting = true;
+}
+
+void ContactStage::resetCounters() {
+
+    for (size_t w = 1; w < workerCounters.size(); w++)
+        workerCounters[w]->reset();
+}
+
+void ContactStage::addCounters(PerfCounters& total) const {
+
+    for (size_t w = 1; w < workerCounters.size(); w++)
+        total.add(*workerCounters[w]);
+}
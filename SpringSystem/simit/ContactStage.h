@@ -0,0 +1,142 @@
+#ifndef _SpringSystem_ContactStage_h
+#define _SpringSystem_ContactStage_h
+
+#include "mesh.h"
+#include "PerfCounters.h"
+#include "WorkerPool.h"
+#include <array>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+// Penalty contact against a ground plane y = ground and between the
+// mesh's own triangles and edges, closer than thickness.
+struct ContactParams
+{
+    double stiffness;	// penalty force per unit penetration
+    double thickness;	// contact distance
+    double ground;		// height of the ground plane
+};
+
+/* Broad and narrow phase of SpringSystem's contact stage, for one mesh
+ * instance at a time.
+ *
+ * Two uniform spatial hashes hold every point in its cell and every edge
+ * in each cell its padded bounding box overlaps. Triangles look up the
+ * points in the cells of their padded box, and edge pairs are tested
+ * inside the bucket of the one cell that owns their overlap, so every
+ * pair is seen once. The boxes carry a skin of one thickness beyond the
+ * contact distance, so the hashes are only rebuilt once a point has moved
+ * half a skin since they were; until then the narrow phase tests the
+ * same candidates at the current positions. All buffers are sized in
+ * setMesh(), so steps after the first do not allocate unless the mesh
+ * stretches into more cells than ever before. */
+class ContactStage
+{
+public:
+
+    typedef std::array<double,3> Vec3;
+
+    explicit ContactStage(int threads = 0);
+
+    // Triangles and unique edges of one instance from a loadObject mesh
+    // (1-based, three edges per face), and its mean rest edge length.
+    void setMesh(const simit::MeshVol& mesh, double edgeLength);
+    void setParams(const ContactParams& p) { params = p; built = false; }
+    void pin(const NumaTopology& numa) { pool.pin(numa); }
+    const ContactParams& getParams() const { return params; }
+
+    // Overwrites f with the contact forces on the points at x.
+    void apply(const std::vector<Vec3>& x, std::vector<Vec3>& f);
+
+    // Narrow phase tests and contacts found by the last apply(), and the
+    // applies so far that rebuilt the hashes.
+    size_t candidates() const { return numCandidates; }
+    size_t contacts() const { return numContacts; }
+    size_t rebuilds() const { return numRebuilds; }
+
+    // Hardware counters of the pool's own threads, counting during every
+    // apply() once opened. Worker 0 is the caller, which counts itself.
+    void openCounters();
+    void resetCounters();
+    // Adds the workers' counts since the last reset to total.
+    void addCounters(PerfCounters& total) const;
+
+private:
+
+    typedef std::array<int,3> Cell;
+
+    // One primitive in one cell, with its padded box so the broad phase
+    // reads buckets sequentially.
+    struct Entry
+    {
+        uint32_t id;
+        int corner;		// bit k set if cell is the first of the range in k
+        uint64_t key;	// the cell this entry was inserted for, see keyOf
+        float box[6];	// padded bounds, min xyz then max xyz
+    };
+
+    // Counting sort of entries into buckets. Every worker counts and
+    // inserts its own share of the primitives, so no atomics are needed
+    // and a bucket lists its entries in primitive order.
+    struct Grid
+    {
+        void resize(size_t entries, int workers);
+        void clear(WorkerPool& pool);
+        void count(int worker, uint32_t bucket) { counts[worker][bucket]++; }
+        size_t prefix(WorkerPool& pool);	// returns the number of entries
+        Entry& insert(int worker, uint32_t bucket) {
+            return items[counts[worker][bucket]++];
+        }
+        size_t buckets() const { return (size_t)mask + 1; }
+
+        uint32_t mask;
+        std::vector<uint32_t> start;	// bucket b holds items[start[b]..start[b+1])
+        std::vector<Entry> items;
+        std::vector<std::vector<uint32_t> > counts;	// per worker and bucket
+        std::vector<size_t> totals;		// per worker's bucket range
+    };
+
+    Cell cellOf(const Vec3& x) const;
+    uint32_t bucketOf(const Cell& c, uint32_t mask) const;
+    static uint64_t keyOf(const Cell& c);
+    template <size_t n>
+    void fill(Grid& grid, const std::vector<Vec3>& x,
+              const std::vector<std::array<int,n> >& prims, double pad);
+
+    void pointTriangle(const std::vector<Vec3>& x, int worker,
+                       size_t begin, size_t end);
+    void edgeEdge(const std::vector<Vec3>& x, int worker,
+                  size_t begin, size_t end);
+    void push(int worker, int p, const Vec3& f, double weight);
+    bool moved(const std::vector<Vec3>& x);
+
+    WorkerPool pool;
+    ContactParams params;
+    double edgeLength;
+    double invCellSize;	// 1/(edgeLength + thickness + skin), per build
+    double skin;		// padding beyond thickness of the last build
+    size_t numPoints;
+    std::vector<std::array<int,3> > triangles;	// 0-based vertex ids
+    std::vector<std::array<int,2> > edges;		// unique, a < b
+    std::vector<std::array<int,1> > pointIds;	// points as primitives of fill
+
+    // per-step state, allocated once in setMesh
+    Grid pointGrid;
+    Grid edgeGrid;
+    std::vector<Cell> primLo;	// cell ranges of the primitives being hashed
+    std::vector<Cell> primHi;
+    std::vector<std::vector<Vec3> > workerForce;
+    std::vector<size_t> workerCandidates;
+    std::vector<size_t> workerContacts;
+    std::vector<char> workerMoved;
+    std::vector<Vec3> builtX;	// positions the hashes were built from
+    bool built;
+    size_t numCandidates;
+    size_t numContacts;
+    size_t numRebuilds;
+    std::vector<std::unique_ptr<PerfCounters> > workerCounters;
+    bool counting;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "MeshPartition.h"
+#include <algorithm>
+
+using namespace std;
+
+MeshPartition::MeshPartition(const simit::MeshVol& mesh, int parts) :
+    mesh(mesh), numParts(max(parts, 1)), tag(0) {
+
+    size_t nv = mesh.v.size();
+    adjacencyStart.assign(nv + 1, 0);
+    for (auto e : mesh.edges) {
+        adjacencyStart[e[0]-1]++;
+        adjacencyStart[e[1]-1]++;
+    }
+    for (size_t i = 0; i < nv; i++)
+        adjacencyStart[i+1] += adjacencyStart[i];
+    adjacency.resize(adjacencyStart[nv]);
+    for (auto e : mesh.edges) {
+        adjacency[--adjacencyStart[e[0]-1]] = e[1]-1;
+        adjacency[--adjacencyStart[e[1]-1]] = e[0]-1;
+    }
+
+    owners.assign(nv, 0);
+    mark.assign(nv, 0);
+    seen.assign(nv, 0);
+    vector<int> all(nv);
+    for (size_t i = 0; i < nv; i++)
+        all[i] = (int)i;
+    bisect(all, numParts, 0);
+}
+
+void MeshPartition::order(vector<int>& vertices) {
+
+    // breadth first from the last vertex a first search reaches, a
+    // pseudo-peripheral one; unreached components follow in turn
+    int set = ++tag;
+    for (int v : vertices)
+        mark[v] = set;
+    vector<int> queue;
+    queue.reserve(vertices.size());
+    int start = vertices.empty() ? -1 : vertices[0];
+    for (int pass = 0; pass < 2; pass++) {
+        int search = ++tag;
+        queue.clear();
+        for (size_t next = 0; queue.size() < vertices.size(); ) {
+            if (next == queue.size()) {
+                // a new component, from the search start or any unvisited
+                int root = start;
+                if (seen[root] == search)
+                    for (int v : vertices)
+                        if (seen[v] != search) {
+                            root = v;
+                            break;
+                        }
+                seen[root] = search;
+                queue.push_back(root);
+            }
+            int v = queue[next++];
+            for (int n = adjacencyStart[v]; n < adjacencyStart[v+1]; n++) {
+                int w = adjacency[n];
+                if ((mark[w] == set) && (seen[w] != search)) {
+                    seen[w] = search;
+                    queue.push_back(w);
+                }
+            }
+        }
+        start = queue.back();
+    }
+    vertices.swap(queue);
+}
+
+void MeshPartition::bisect(vector<int>& vertices, int parts, int first) {
+
+    if (parts == 1) {
+        // split parts are already ordered, a single one is not
+        if (numParts == 1)
+            order(vertices);
+        for (int v : vertices)
+            owners[v] = first;
+        sequence.insert(sequence.end(), vertices.begin(), vertices.end());
+        return;
+    }
+    order(vertices);
+    int left = parts/2;
+    size_t split = vertices.size()*left/parts;
+    vector<int> upper(vertices.begin() + split, vertices.end());
+    vertices.resize(split);
+    bisect(vertices, left, first);
+    bisect(upper, parts - left, first + left);
+}
+
+size_t MeshPartition::cutEdges() const {
+
+    size_t cut = 0;
+    for (auto e : mesh.edges)
+        cut += (owners[e[0]-1] != owners[e[1]-1]);
+    return cut;
+}
+
+size_t MeshPartition::localVertices(int part, vector<int>& vertices) const {
+
+    vertices.clear();
+    for (size_t v = 0; v < owners.size(); v++)
+        if (owners[v] == part)
+            vertices.push_back((int)v);
+    size_t owned = vertices.size();
+    vector<bool> ghost(owners.size(), false);
+    for (size_t i = 0; i < owned; i++) {
+        int v = vertices[i];
+        for (int n = adjacencyStart[v]; n < adjacencyStart[v+1]; n++) {
+            int w = adjacency[n];
+            if ((owners[w] != part) && !ghost[w]) {
+                ghost[w] = true;
+                vertices.push_back(w);
+            }
+        }
+    }
+    return owned;
+}
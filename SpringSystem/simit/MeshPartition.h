@@ -0,0 +1,48 @@
+#ifndef _SpringSystem_MeshPartition_h
+#define _SpringSystem_MeshPartition_h
+
+#include "mesh.h"
+#include <stddef.h>
+#include <vector>
+
+/* Splits a loadObject mesh (1-based edges) into parts of nearly equal
+ * vertex counts by recursive graph bisection: each half is the first half
+ * of a breadth first order of the spring graph, started from a vertex far
+ * from the rest, which keeps parts connected and their cuts short. */
+class MeshPartition
+{
+public:
+
+    MeshPartition(const simit::MeshVol& mesh, int parts);
+
+    int parts() const { return numParts; }
+    int owner(int vertex) const { return owners[vertex]; }
+
+    // All vertices part by part, each part in breadth first order.
+    const std::vector<int>& ordering() const { return sequence; }
+
+    // Springs whose endpoints lie in different parts.
+    size_t cutEdges() const;
+
+    // The vertices part p owns followed by its ghosts, the vertices of
+    // other parts that share a spring with an owned one. Returns the number
+    // of owned vertices.
+    size_t localVertices(int part, std::vector<int>& vertices) const;
+
+private:
+
+    void bisect(std::vector<int>& vertices, int parts, int first);
+    void order(std::vector<int>& vertices);
+
+    const simit::MeshVol& mesh;
+    int numParts;
+    std::vector<int> owners;
+    std::vector<int> sequence;
+    std::vector<int> adjacencyStart;	// neighbours of v, 0-based, CSR
+    std::vector<int> adjacency;
+    std::vector<int> mark;		// tag of the set being ordered
+    std::vector<int> seen;		// tag of the last search to visit
+    int tag;
+};
+
+#endif
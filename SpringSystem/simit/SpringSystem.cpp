@@ -1,10 +1,23 @@
 #include "SpringSystem.h"
+#include "FloatField.h"
+#include "MeshCache.h"
+#include "MeshGenerator.h"
+#include "MeshPartition.h"
+#include "SimitSource.h"
+#include <algorithm>
 #include <cmath>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <stdexcept>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <typeinfo>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define str(s) #s
 #define toString(s) str(s) 
@@ -13,7 +26,8 @@
 using namespace std;
 
 const int spacing = 2;
-const int spr_k = 1e5;
+const SpringParams defaultParams = { 1e5, 0.99, 1e-3 };	// k, damping, h
+const int sleepInterval = 10;	// steps between settle() checks
 
 float angleX = 0.f;
 float angleY = 0.f;
@@ -69,132 +83,764 @@ static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 /* ********************* */
 
 
-SpringSystem::SpringSystem() : points(), springs(points,points) {
+SpringSystem::SpringSystem() : precision(DoublePrecision), points(), 
+	springs(points,points), perInstance(false), contact(false), contactTime(0.0), sleeping(false),
+	sleepSpeed(numeric_limits<double>::quiet_NaN()), sleepChecks(10),
+	stepCount(0), compacted(false), ownedPoints(0),
+	haloTime(0.0), numaAware(false), numaPages(0), numaLocal(0),
+	profiling(false), memoryReport(false), exportInterval(10), exportSteps(0),
+	exportTime(0.0), nativeEngine(false), nativeTime(0.0) {
 
-
-	int numX = spacing;
-	int numY = spacing;
-	int z = 0; // set z to 0 for in plane mesh
-	
-/*
-	// Create points
-	//DBG//cout<<"Building mesh vertices\n";
-    for(int i = 0; i < numX; i++) {
-        for(int j = 0; j < numY; j++) {
-//DBG//cout << ">>>>Creating point (" << i << ", " << j << ", " << z << ")" << endl;
-            mesh.v.push_back({static_cast<simit_float>(i), 
-            	static_cast<simit_float>(j), static_cast<simit_float>(z)});
-        }
-    }
-    
-    // Create springs
-	//DBG//cout<<"Building mesh edges\n";
-    for(int i = 0; i < numX - 1; i++) {
-        for(int j = 0; j < numY; j++) {
-       	 cout << ">>>>Creating spring between points " << i*numY+j << " and " << 
-       	 	(i+1)*numY+j << endl;
-         mesh.edges.push_back({i*numY+j, (i+1)*numY+j});
-        }
-    }	
-
-    for(int i = 0; i < numX; i++) {
-        for(int j = 0; j < numY - 1; j++) {
-       	 cout << ">>>>Creating spring between points " << i*numY+j << " and " << 
-       	 	i*numY+(j+1) << endl;
-         mesh.edges.push_back({i*numY+j, i*numY+(j+1)});
-        }
-    }	
-*/
+	gravity.set({{0.0, -9.8, 0.0}});
+	contactParams.stiffness = 1e4;
+	contactParams.thickness = numeric_limits<double>::quiet_NaN();
+	contactParams.ground = numeric_limits<double>::quiet_NaN();
 }
 
 void SpringSystem::load() {
 
 	srand ( time(NULL) );
     //DBG//cout<<"Setting field references\n";	
-    simit::FieldRef<simit_float,3> position = 
-    	points.addField<simit_float,3>("position");
-    simit::FieldRef<simit_float,3> velocity = 
-    	points.addField<simit_float,3>("velocity");
-    simit::FieldRef<simit_float> mass = points.addField<simit_float>("mass");
+    FloatField<3> position = 
+    	FloatField<3>::add(points, "position", precision);
+    FloatField<3> velocity = 
+    	FloatField<3>::add(points, "velocity", precision);
+    FloatField<> mass = FloatField<>::add(points, "mass", precision);
     simit::FieldRef<bool> pinned = points.addField<bool>("pinned");
     
 
-    simit::FieldRef<simit_float> k = springs.addField<simit_float>("k");
-    simit::FieldRef<simit_float> L_0 = springs.addField<simit_float>("L_0");
-    simit::FieldRef<simit_float> strain = 
-    	springs.addField<simit_float>("strain");
-
-    vector<simit::ElementRef> pointRefs;
-    bool pinStart = false;
-    int count = 0;
-    for(auto v : mesh.v) {
-        pointRefs.push_back(points.add());
-        simit::ElementRef pRef = pointRefs.back();
-        
-        //DBG//cout << v[0] << v[1] << v[2] << endl;
-        position.set(pRef, {v[0], v[1], v[2]});
-      	velocity.set(pRef, {0.0, 0.0, 0.0});
-      	//((rand() % 10) < 2);
-      	if ((count == 3) || (count == 6))
-      		pinStart = true;
-      	count++;
-      	if (pinStart) {
-      		mass.set(pRef, numeric_limits<float>::infinity());
-	      	pinned.set(pRef, true);     
-	      	pinStart = false; 		
-		} else {
-	      	mass.set(pRef, 1.0);
-      		pinned.set(pRef, false);
-      	}
-	}
-
-    for(auto e : mesh.edges) {
-        simit::ElementRef sRef = springs.add(pointRefs[e[0]-1], 
-        									 pointRefs[e[1]-1]); 
-        std::array<double,3> pA = mesh.v[e[0]-1];
-        std::array<double,3> pB = mesh.v[e[1]-1];      
-        double spr_L0 = sqrt(((pA[0])-(pB[0])) * 		
-        					((pA[0])-(pB[0])) +
-        					((pA[1])-(pB[1])) * 		
-        					((pA[1])-(pB[1])) +
-        					((pA[2])-(pB[2])) * 		
-        					((pA[2])-(pB[2])) );
-		//DBG//cout << e[0] << " " << e[1] << endl;
-		//DBG//cout << setprecision(10) <<pA[0] << " " << pB[0] <<endl 
-		//DBG//	 << pA[1] << " " << pB[1] <<endl
-		//DBG//	 << pA[2] << " " << pB[2] <<endl;        								
-        //DBG//cout << spr_L0 << endl;
-//        float stretch = ((rand() % 20)-1.f)/100.0; 	//add random stretch to springs
-		float stretch = 0.f;
-        L_0.set(sRef, spr_L0*(1.f+stretch));
-        k.set(sRef, spr_k);
-        strain.set(sRef, 0);
+    FloatField<> k = FloatField<>::add(springs, "k", precision);
+    FloatField<> L_0 = FloatField<>::add(springs, "L_0", precision);
+    FloatField<> strain = 
+    	FloatField<>::add(springs, "strain", precision);
+
+    // one instance reads its time step and damping from the parameters
+    // extern, see compile()
+    FloatField<> h, damping;
+    if (perInstance) {
+        h = FloatField<>::add(points, "h", precision);
+        damping = FloatField<>::add(points, "damping", precision);
     }
+    FloatField<3> contactForce = 
+    	FloatField<3>::add(points, "contact", precision);
+    simit::FieldRef<bool> asleep = points.addField<bool>("asleep");
+    positionField = position;
+    velocityField = velocity;
+    contactField = contactForce;
 
+    // a sweep replicates the mesh once per instance, each copy carrying
+    // its own parameters, so all of them advance in one run()
+    if (instances.empty())
+        instances.push_back(defaultParams);
 
-    // Load simit program here
-    string filename = string(toString(SIMIT_CODE_DIR))+"/SpringSystem.sim";
-    FILE *fin = fopen(filename.c_str(), "r");
-   
-    //DBG//cout<<"Loading "<<filename<<"\n";
-    
-    //load simit program
-    int errorCode = program.loadFile(filename);
+    // the vector fields of an instance's points are one block each, written
+    // in bulk once the points exist
+    vector<FloatField<3>::Value> restPosition(mesh.v.size());
+    vector<FloatField<3>::Value> zero(mesh.v.size(), {{0.0, 0.0, 0.0}});
+    for (size_t i = 0; i < mesh.v.size(); i++)
+        restPosition[i] = {{mesh.v[i][0], mesh.v[i][1], mesh.v[i][2]}};
 
-    if(errorCode) { cout<<program.getDiagnostics().getMessage(); exit(0); }
+    pointRefs.clear();
+    springRefs.clear();
+    for (const SpringParams& params : instances) {
+        size_t base = pointRefs.size();
+        bool pinStart = false;
+        int count = 0;
+        for(size_t i = 0; i < mesh.v.size(); i++) {
+            pointRefs.push_back(points.add());
+            simit::ElementRef pRef = pointRefs.back();
+        
+          	asleep.set(pRef, false);
+          	if (perInstance) {
+          		h.set(pRef, params.h);
+          		damping.set(pRef, params.damping);
+          	}
+          	//((rand() % 10) < 2);
+          	// pins follow the vertex numbers of the whole mesh
+          	int id = globalIds.empty() ? count : globalIds[count];
+          	if ((id == 3) || (id == 6))
+          		pinStart = true;
+          	count++;
+          	if (pinStart) {
+          		mass.set(pRef, numeric_limits<float>::infinity());
+    	      	pinned.set(pRef, true);     
+    	      	pinStart = false; 		
+    		} else {
+    	      	mass.set(pRef, 1.0);
+          		pinned.set(pRef, false);
+          	}
+    	}
+        if (!mesh.v.empty()) {
+            size_t nv = mesh.v.size();
+            position.setRange(pointRefs[base], nv, restPosition.data());
+            velocity.setRange(pointRefs[base], nv, zero.data());
+            contactForce.setRange(pointRefs[base], nv, zero.data());
+        }
 
-    //DBG//cout<<"Compiling \n";
+        for(size_t i = 0; i < mesh.edges.size(); i++) {
+            std::array<int,2> e = mesh.edges[i];
+            simit::ElementRef sRef = springs.add(pointRefs[base+e[0]-1], 
+            									 pointRefs[base+e[1]-1]); 
+            springRefs.push_back(sRef);
+            double spr_L0 = restLength[i];
+//        float stretch = ((rand() % 20)-1.f)/100.0; 	//add random stretch to springs
+    		float stretch = 0.f;
+            L_0.set(sRef, spr_L0*(1.f+stretch));
+            k.set(sRef, params.k);
+            strain.set(sRef, 0);
+        }
+    }
 
-    timeStepper = program.compile("main");
+
+    if (memoryReport) {
+        memory.addSet("points", points.getSize());
+        memory.addSet("springs", springs.getSize());
+        memory.addField("points", "position", position.bytes());
+        memory.addField("points", "velocity", velocity.bytes());
+        memory.addField("points", "contact", contactForce.bytes());
+        memory.addField("points", "mass", mass.bytes());
+        if (perInstance) {
+            memory.addField("points", "h", h.bytes());
+            memory.addField("points", "damping", damping.bytes());
+        }
+        memory.addField("points", "pinned", sizeof(bool));
+        memory.addField("points", "asleep", sizeof(bool));
+        memory.addField("springs", "k", k.bytes());
+        memory.addField("springs", "L_0", L_0.bytes());
+        memory.addField("springs", "strain", strain.bytes());
+        memory.addField("springs", "endpoints", 2*sizeof(int));
+        reportMemory("after load");
+    }
+
+    // the program was compiled on a background thread while the sets were
+    // filled; wait for it and bind
+    if (!compiled.valid())
+        compile();
+    try {
+        compiled.get();
+    } catch (const runtime_error& err) {
+        cout << err.what();
+        exit(0);
+    }
 
     //DBG//cout<<"Binding \n";
-    timeStepper.bind("points", &points);
-    timeStepper.bind("springs", &springs);
+    gravity.bind(timeStepper, "gravity", precision);
+    if (!perInstance) {
+        parameters.set({{instances[0].h, instances[0].damping}});
+        parameters.bind(timeStepper, "parameters", precision);
+    }
+    if (contact) {
+        gravity.bind(positionUpdate, "gravity", precision);
+        if (!perInstance)
+            parameters.bind(positionUpdate, "parameters", precision);
+    }
     //DBG//cout<<"Initializing \n";
-    timeStepper.init();
-    
+    bindSets(points, springs);
+
+    if (contact) {
+        // a thickness of a twentieth of the mean rest edge keeps the
+        // bunny's rest pose free of contacts, and the ground sits a
+        // little below the lowest vertex
+        double meanEdge = meanRestLength();
+        double lo = numeric_limits<double>::infinity();
+        double hi = -lo;
+        for (auto v : mesh.v) {
+            lo = min<double>(lo, v[1]);
+            hi = max<double>(hi, v[1]);
+        }
+        if (std::isnan(contactParams.thickness))
+            contactParams.thickness = 0.05 * meanEdge;
+        if (std::isnan(contactParams.ground))
+            contactParams.ground = lo - 0.1 * (hi - lo);
+
+        contacts.reset(new ContactStage());
+        contacts->setMesh(mesh, meanEdge);
+        contacts->setParams(contactParams);
+        contactX.resize(mesh.v.size());
+        contactF.resize(mesh.v.size());
+    }
+
+    if (sleeping) {
+        // a point is calm below this speed, about a hundredth of a rest
+        // edge per hundred steps of the default time step
+        if (std::isnan(sleepSpeed))
+            sleepSpeed = 0.1 * meanRestLength();
+
+        // edges are 1-based, the tracker's points 0-based over all
+        // instances
+        size_t nv = mesh.v.size();
+        vector<int> ends;
+        ends.reserve(2*springRefs.size());
+        for (size_t i = 0; i < instances.size(); i++)
+            for (auto e : mesh.edges) {
+                ends.push_back(i*nv + e[0]-1);
+                ends.push_back(i*nv + e[1]-1);
+            }
+        sleep.setElements(pointRefs.size(), 2, 3, ends);
+        sleep.setLimits(sleepSpeed, sleepChecks);
+        compactOf.assign(pointRefs.size(), -1);
+    }
+
+    if (nativeEngine)
+        loadNative();
+
+    if (!exportName.empty() || !recordPath.empty()) {
+        vector<int> ends;
+        size_t nv = mesh.v.size();
+        for (size_t i = 0; i < instances.size(); i++)
+            for (auto e : mesh.edges) {
+                ends.push_back(i*nv + e[0]-1);
+                ends.push_back(i*nv + e[1]-1);
+            }
+        if (!exportName.empty())
+            exporter.reset(new StateExport(exportName, pointRefs.size(), 3,
+                                           ends, 2));
+        if (!recordPath.empty())
+            recorder.reset(new TrajectoryWriter(recordPath, pointRefs.size(),
+                                                3, ends, 2));
+        exportPositions.resize(3*pointRefs.size());
+        exportState();
+    }
+
+    if (memoryReport)
+        reportMemory("after init");
+
+    if (!layer || (layer->rank() == 0))
+        cout << "Startup: compile " << compileTime << " ms, total "
+             << chrono::duration<double,milli>(
+                    chrono::steady_clock::now() - startupBegin).count()
+             << " ms" << endl;
     }
+
+void SpringSystem::reportMemory(const string& phase) {
+
+	// the temporaries of a proc at their peak, and the rest of its arena,
+	// which bump allocation does not reuse within a run
+	string step = contact ? "forces" : "main";
+	memory.setOther("temporaries of " + step + " at their peak",
+					stepArena.peak());
+	memory.setOther("rest of the arena of " + step,
+					stepArena.capacity() - min(stepArena.peak(),
+											   stepArena.capacity()));
+	if (contact) {
+		memory.setOther("temporaries of move at their peak",
+						moveArena.peak());
+		memory.setOther("rest of the arena of move",
+						moveArena.capacity() - min(moveArena.peak(),
+												   moveArena.capacity()));
+	}
+	memory.setOther("host mesh and element refs",
+					mesh.v.size()*sizeof(mesh.v[0]) +
+					mesh.edges.size()*sizeof(mesh.edges[0]) +
+					restLength.size()*sizeof(double) +
+					(pointRefs.size() + springRefs.size()) *
+						sizeof(simit::ElementRef));
+	if (contact)
+		memory.setOther("contact positions and forces",
+						(contactX.size() + contactF.size()) *
+							sizeof(ContactStage::Vec3));
+	if (!layer || (layer->rank() == 0))
+		memory.print(cout, phase);
+}
+
+void SpringSystem::compile() {
+
+    startupBegin = chrono::steady_clock::now();
+
+    // Only a sweep has per point time steps and dampings; a single
+    // instance binds them as one extern instead of two fields, keeping
+    // two floats per point out of every step's traffic.
+    perInstance = instances.size() > 1;
+    SimitSource source;
+    source.define(perInstance ? "sweep" : "single");
+
+    // the temporaries of the procs compiled below come from the arenas
+    StepArena::hookCompiledProcs();
+
+    // Parsing the mesh and JIT compiling the program are independent, so
+    // compilation runs on its own thread until load() needs the Function.
+    compiled = async(launch::async, [this, source]() {
+        auto start = chrono::steady_clock::now();
+
+        // Load simit program here
+        string filename = string(toString(SIMIT_CODE_DIR))+"/SpringSystem.sim";
+
+        //DBG//cout<<"Loading "<<filename<<"\n";
+
+        //load simit program
+        string code;
+        if (!source.read(filename, code))
+            throw runtime_error("Unable to read " + filename + "\n");
+        int errorCode = program.loadString(code);
+
+        if(errorCode) throw runtime_error(program.getDiagnostics().getMessage());
+
+        //DBG//cout<<"Compiling \n";
+
+        if (contact) {
+            positionUpdate = program.compile("move");
+            timeStepper = program.compile("forces");
+        } else {
+            timeStepper = program.compile("main");
+        }
+
+        compileTime = chrono::duration<double,milli>(
+                          chrono::steady_clock::now() - start).count();
+    });
+}
     
+void SpringSystem::advance() {
+
+	// with every point asleep there is nothing to step, only contacts
+	// that could wake them
+	bool idle = compacted && activePoints.empty();
+	if (native) {
+		nativeStep();
+	} else if (contact) {
+		if (!idle) {
+			StepArena::Scope scope(moveArena);
+			moveCounters.start();
+			positionUpdate.run();
+			moveCounters.stop();
+			if (compacted)
+				scatter();
+		}
+		contactCounters.start();
+		collide();
+		contactCounters.stop();
+	}
+	if (!native && !idle) {
+		StepArena::Scope scope(stepArena);
+		stepCounters.start();
+		timeStepper.run();
+		stepCounters.stop();
+		if (compacted)
+			scatter();
+	}
+
+	if (layer)
+		exchangeHalo();
+	if (sleeping && (++stepCount % sleepInterval == 0))
+		settle();
+
+	if (exporter || recorder) {
+		exportTime += instances[0].h;
+		if (++exportSteps % exportInterval == 0)
+			exportState();
+	}
+}
+
+void SpringSystem::loadNative() {
+
+	FloatField<> mass = FloatField<>::get(points, "mass", precision);
+	FloatField<> k = FloatField<>::get(springs, "k", precision);
+	FloatField<> L_0 = FloatField<>::get(springs, "L_0", precision);
+	simit::FieldRef<bool> pinned = points.getField<bool>("pinned");
+
+	if (precision == SinglePrecision)
+		native.reset(new NativeEngine<float,3,SpringElement>());
+	else
+		native.reset(new NativeEngine<double,3,SpringElement>());
+	native->resize(pointRefs.size(), springRefs.size());
+
+	// pinned points have infinite mass, so neither forces nor gravity
+	// move them
+	FloatExtern<3>::Value g = gravity.get();
+	size_t nv = mesh.v.size();
+	for (size_t i = 0; i < pointRefs.size(); i++) {
+		simit::ElementRef p = pointRefs[i];
+		const SpringParams& params = instances[i/nv];
+		FloatField<3>::Value x = positionField.get(p);
+		FloatField<3>::Value v = velocityField.get(p);
+		double m = mass.get(p);
+		bool pin = pinned.get(p);
+		double load[3] = { pin ? 0.0 : m*g[0], pin ? 0.0 : m*g[1],
+						   pin ? 0.0 : m*g[2] };
+		native->setPoint(i, x.data(), v.data(), params.h, pin ? 0.0 : 1.0/m,
+						 params.damping, load);
+	}
+	size_t ne = mesh.edges.size();
+	for (size_t i = 0; i < springRefs.size(); i++) {
+		size_t base = (i/ne)*nv;
+		std::array<int,2> e = mesh.edges[i%ne];
+		int ends[2] = { (int)(base + e[0]-1), (int)(base + e[1]-1) };
+		double params[2] = { k.get(springRefs[i]), L_0.get(springRefs[i]) };
+		native->setElement(i, ends, params);
+	}
+}
+
+void SpringSystem::nativeStep() {
+
+	auto start = chrono::steady_clock::now();
+	stepCounters.start();
+	native->step();
+	stepCounters.stop();
+	nativeTime += chrono::duration<double,milli>(
+					  chrono::steady_clock::now() - start).count();
+
+	FloatField<3>::Value x, v;
+	for (size_t i = 0; i < pointRefs.size(); i++) {
+		native->getState(i, x.data(), v.data());
+		positionField.set(pointRefs[i], x);
+		velocityField.set(pointRefs[i], v);
+	}
+}
+
+// Runs main for numSteps from the current state into referencePosition,
+// then restores that state; returns the milliseconds main took.
+double SpringSystem::referenceRun(int numSteps) {
+
+	size_t n = pointRefs.size();
+	vector<FloatField<3>::Value> x(n), v(n);
+	for (size_t i = 0; i < n; i++) {
+		x[i] = positionField.get(pointRefs[i]);
+		v[i] = velocityField.get(pointRefs[i]);
+	}
+
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < numSteps; i++) {
+		StepArena::Scope scope(stepArena);
+		timeStepper.run();
+	}
+	double ms = chrono::duration<double,milli>(
+					chrono::steady_clock::now() - start).count();
+
+	referencePosition.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		referencePosition[i] = positionField.get(pointRefs[i]);
+		positionField.set(pointRefs[i], x[i]);
+		velocityField.set(pointRefs[i], v[i]);
+		native->setState(i, x[i].data(), v[i].data());
+	}
+	return ms;
+}
+
+void SpringSystem::exportState() {
+
+	for (size_t i = 0; i < pointRefs.size(); i++) {
+		FloatField<3>::Value x = positionField.get(pointRefs[i]);
+		for (int d = 0; d < 3; d++)
+			exportPositions[3*i + d] = (float)x[d];
+	}
+	if (exporter)
+		exporter->publish(exportSteps, exportTime, exportPositions.data());
+	if (recorder)
+		recorder->write(exportSteps, exportTime, exportPositions.data());
+}
+
+bool SpringSystem::partition(int parts) {
+
+	MeshPartition split(mesh, parts);
+	cout << "Partitions: " << parts << ", " << split.cutEdges() << " of "
+		 << mesh.edges.size() << " springs cut" << endl;
+
+	// position and velocity of every point of the whole mesh
+	SharedMemoryLayer* shared = new SharedMemoryLayer(parts, mesh.v.size(), 6);
+	layer.reset(shared);
+	if (!shared->valid())
+		return false;
+	int rank = 0;
+	for (int r = 1; r < parts; r++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			// the ranks forked so far would wait forever at the first
+			// barrier, which counts all parts
+			perror("fork");
+			for (pid_t child : children)
+				kill(child, SIGKILL);
+			for (pid_t child : children)
+				waitpid(child, NULL, 0);
+			children.clear();
+			return false;
+		}
+		if (pid == 0) {
+			rank = r;
+			children.clear();
+			break;
+		}
+		children.push_back(pid);
+	}
+	shared->select(rank);
+
+	// this rank fills its own sets, so they are first touched on its node
+	if (numaAware)
+		numa.pin(numa.nodeOf(rank, parts));
+
+	// keep the springs that touch an owned vertex, renumbered to the
+	// local vertices
+	vector<int> local;
+	ownedPoints = split.localVertices(rank, local);
+	vector<int> localOf(mesh.v.size(), -1);
+	for (size_t i = 0; i < local.size(); i++)
+		localOf[local[i]] = (int)i;
+	simit::MeshVol part;
+	vector<double> partRest;
+	vector<bool> boundary(ownedPoints, false);
+	for (int v : local)
+		part.v.push_back(mesh.v[v]);
+	for (size_t i = 0; i < mesh.edges.size(); i++) {
+		int a = mesh.edges[i][0]-1;
+		int b = mesh.edges[i][1]-1;
+		if ((split.owner(a) != rank) && (split.owner(b) != rank))
+			continue;
+		part.edges.push_back({localOf[a]+1, localOf[b]+1});
+		partRest.push_back(restLength[i]);
+		if (split.owner(a) != split.owner(b))
+			boundary[(split.owner(a) == rank) ? localOf[a] : localOf[b]] = true;
+	}
+
+	sendLocal.clear();
+	sendGlobal.clear();
+	for (size_t i = 0; i < ownedPoints; i++)
+		if (boundary[i]) {
+			sendLocal.push_back((int)i);
+			sendGlobal.push_back(local[i]);
+		}
+	ghostLocal.clear();
+	ghostGlobal.clear();
+	for (size_t i = ownedPoints; i < local.size(); i++) {
+		ghostLocal.push_back((int)i);
+		ghostGlobal.push_back(local[i]);
+	}
+
+	swap(mesh, part);
+	swap(restLength, partRest);
+	globalIds.swap(local);
+	return true;
+}
+
+void SpringSystem::countLocalPages() {
+
+	// simit's maps all run on the rank's calling thread, pinned to its
+	// node, so that is where the vector fields should live
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t nv = mesh.v.size();
+	int node = numa.current();
+	numaPages = 0;
+	numaLocal = 0;
+	for (size_t instance = 0; instance < instances.size(); instance++) {
+		simit::ElementRef first = pointRefs[instance*nv];
+		simit::ElementRef last = pointRefs[(instance+1)*nv - 1];
+		for (const FloatField<3>* f :
+			 {&positionField, &velocityField, &contactField}) {
+			const char* begin = (const char*)f->address(first);
+			size_t bytes = (const char*)f->address(last) - begin + f->bytes();
+			numaPages += ((size_t)begin % page + bytes + page-1) / page;
+			numaLocal += numa.pagesOn(begin, bytes, node);
+		}
+	}
+}
+
+void SpringSystem::joinPartitions() {
+
+	for (pid_t pid : children)
+		waitpid(pid, NULL, 0);
+	children.clear();
+}
+
+void SpringSystem::exchangeHalo() {
+
+	auto start = chrono::steady_clock::now();
+
+	FloatField<3>& position = positionField;
+	FloatField<3>& velocity = velocityField;
+	haloValues.resize(6*sendLocal.size());
+	for (size_t i = 0; i < sendLocal.size(); i++) {
+		FloatField<3>::Value x = position.get(pointRefs[sendLocal[i]]);
+		FloatField<3>::Value v = velocity.get(pointRefs[sendLocal[i]]);
+		copy(x.begin(), x.end(), &haloValues[6*i]);
+		copy(v.begin(), v.end(), &haloValues[6*i+3]);
+	}
+	layer->publish(sendGlobal, haloValues);
+	layer->collect(ghostGlobal, haloValues);
+	for (size_t i = 0; i < ghostLocal.size(); i++) {
+		simit::ElementRef p = pointRefs[ghostLocal[i]];
+		position.set(p, {{haloValues[6*i], haloValues[6*i+1], haloValues[6*i+2]}});
+		velocity.set(p, {{haloValues[6*i+3], haloValues[6*i+4],
+						  haloValues[6*i+5]}});
+	}
+
+	haloTime += chrono::duration<double,milli>(
+					chrono::steady_clock::now() - start).count();
+}
+
+double SpringSystem::meanRestLength() const {
+
+	double sum = 0.0;
+	for (double L : restLength)
+		sum += L;
+	return sum / max<size_t>(restLength.size(), 1);
+}
+
+void SpringSystem::settle() {
+
+	// only the awake points are observed, from the set main ran on
+	for (size_t p : sleep.awake()) {
+		FloatField<3>::Value v = compacted
+			? awakeVelocity.get(awakePointRefs[compactOf[p]])
+			: velocityField.get(pointRefs[p]);
+		sleep.observe(p, v.data());
+	}
+	if (!sleep.settle())
+		return;
+
+	simit::FieldRef<bool> asleep = points.getField<bool>("asleep");
+	for (size_t p : sleep.fellAsleep()) {
+		asleep.set(pointRefs[p], true);
+		velocityField.set(pointRefs[p], {{0.0, 0.0, 0.0}});
+	}
+	for (size_t p : sleep.woke())
+		asleep.set(pointRefs[p], false);
+	compactSets();
+}
+
+void SpringSystem::bindSets(simit::Set& stepPoints, simit::Set& stepSprings) {
+
+	timeStepper.bind("points", &stepPoints);
+	timeStepper.bind("springs", &stepSprings);
+	timeStepper.init();
+	if (contact) {
+		positionUpdate.bind("points", &stepPoints);
+		positionUpdate.bind("springs", &stepSprings);
+		positionUpdate.init();
+	}
+}
+
+void SpringSystem::compactSets() {
+
+	for (size_t p : activePoints)
+		compactOf[p] = -1;
+	if (sleep.awake().size() == sleep.points()) {
+		activePoints.clear();
+		activeSprings.clear();
+		if (compacted)
+			bindSets(points, springs);
+		compacted = false;
+		awakeSprings.reset();
+		awakePoints.reset();
+		return;
+	}
+	compacted = true;
+	sleep.compact(activePoints, activeSprings);
+	awakePointRefs.clear();
+	if (activePoints.empty()) {
+		awakeSprings.reset();
+		awakePoints.reset();
+		return;
+	}
+
+	// copies of the active springs and their points, from the full sets,
+	// which are current: the awake points were scattered after the last
+	// run and settle() wrote the sleepers. A strain is only read in the
+	// step that computes it, so the full set's stale strains do no harm.
+	unique_ptr<simit::Set> stepPoints(new simit::Set());
+	unique_ptr<simit::Set> stepSprings(
+		new simit::Set(*stepPoints, *stepPoints));
+	FloatField<3> position =
+		FloatField<3>::add(*stepPoints, "position", precision);
+	FloatField<3> velocity =
+		FloatField<3>::add(*stepPoints, "velocity", precision);
+	FloatField<> mass = FloatField<>::add(*stepPoints, "mass", precision);
+	simit::FieldRef<bool> pinned = stepPoints->addField<bool>("pinned");
+	FloatField<> h, damping, fullH, fullDamping;
+	if (perInstance) {
+		h = FloatField<>::add(*stepPoints, "h", precision);
+		damping = FloatField<>::add(*stepPoints, "damping", precision);
+		fullH = FloatField<>::get(points, "h", precision);
+		fullDamping = FloatField<>::get(points, "damping", precision);
+	}
+	FloatField<3> contactForce =
+		FloatField<3>::add(*stepPoints, "contact", precision);
+	simit::FieldRef<bool> asleep = stepPoints->addField<bool>("asleep");
+	FloatField<> k = FloatField<>::add(*stepSprings, "k", precision);
+	FloatField<> L_0 = FloatField<>::add(*stepSprings, "L_0", precision);
+	FloatField<> strain = FloatField<>::add(*stepSprings, "strain", precision);
+
+	FloatField<> fullMass = FloatField<>::get(points, "mass", precision);
+	simit::FieldRef<bool> fullPinned = points.getField<bool>("pinned");
+	simit::FieldRef<bool> fullAsleep = points.getField<bool>("asleep");
+	for (size_t i = 0; i < activePoints.size(); i++) {
+		simit::ElementRef from = pointRefs[activePoints[i]];
+		simit::ElementRef to = stepPoints->add();
+		awakePointRefs.push_back(to);
+		compactOf[activePoints[i]] = i;
+		position.set(to, positionField.get(from));
+		velocity.set(to, velocityField.get(from));
+		mass.set(to, fullMass.get(from));
+		pinned.set(to, fullPinned.get(from));
+		if (perInstance) {
+			h.set(to, fullH.get(from));
+			damping.set(to, fullDamping.get(from));
+		}
+		contactForce.set(to, contactField.get(from));
+		asleep.set(to, fullAsleep.get(from));
+	}
+
+	FloatField<> fullK = FloatField<>::get(springs, "k", precision);
+	FloatField<> fullL_0 = FloatField<>::get(springs, "L_0", precision);
+	FloatField<> fullStrain = FloatField<>::get(springs, "strain", precision);
+	size_t nv = mesh.v.size(), ne = mesh.edges.size();
+	for (size_t s : activeSprings) {
+		size_t base = (s/ne)*nv;
+		std::array<int,2> e = mesh.edges[s%ne];
+		simit::ElementRef to = stepSprings->add(
+			awakePointRefs[compactOf[base + e[0]-1]],
+			awakePointRefs[compactOf[base + e[1]-1]]);
+		k.set(to, fullK.get(springRefs[s]));
+		L_0.set(to, fullL_0.get(springRefs[s]));
+		strain.set(to, fullStrain.get(springRefs[s]));
+	}
+
+	// bind the new sets before the old ones go, springs before the points
+	// they refer to
+	bindSets(*stepPoints, *stepSprings);
+	awakeSprings = std::move(stepSprings);
+	awakePoints = std::move(stepPoints);
+	awakePosition = position;
+	awakeVelocity = velocity;
+	awakeContact = contactForce;
+}
+
+void SpringSystem::scatter() {
+
+	// the sleeping points of the awake sets do not move
+	for (size_t p : sleep.awake()) {
+		simit::ElementRef from = awakePointRefs[compactOf[p]];
+		positionField.set(pointRefs[p], awakePosition.get(from));
+		velocityField.set(pointRefs[p], awakeVelocity.get(from));
+	}
+}
+
+void SpringSystem::collide() {
+
+	auto start = chrono::steady_clock::now();
+
+	// instances share no points, so each one collides on its own; an
+	// instance's points are one block of each field
+	size_t nv = mesh.v.size();
+	for (size_t i = 0; i < instances.size(); i++) {
+		positionField.getRange(pointRefs[i*nv], nv, contactX.data());
+		contacts->apply(contactX, contactF);
+		contactField.setRange(pointRefs[i*nv], nv, contactF.data());
+
+		// a contact wakes a sleeping point at the next check
+		if (sleeping)
+			for (size_t j = 0; j < nv; j++) {
+				const ContactStage::Vec3& f = contactF[j];
+				if (((f[0] != 0.0) || (f[1] != 0.0) || (f[2] != 0.0)) &&
+					sleep.asleep(i*nv + j))
+					sleep.wake(i*nv + j);
+			}
+	}
+	if (compacted)
+		for (size_t i = 0; i < activePoints.size(); i++)
+			awakeContact.set(awakePointRefs[i],
+							 contactField.get(pointRefs[activePoints[i]]));
+
+	contactTime += chrono::duration<double,milli>(
+					   chrono::steady_clock::now() - start).count();
+}
+
 void SpringSystem::step() {
 
 	int numSteps = -1;		// negative for unbounded
@@ -253,17 +899,15 @@ void SpringSystem::step() {
 		glTranslatef(panX, panY, 0.f);
 		//DBG//cout<<"Running\n";
 		if (numSteps > 0) {
-			timeStepper.run();
+			advance();
 			numSteps--;
 		} else if (numSteps < 0) {
-			timeStepper.run();
+			advance();
 		}
   
 		//DBG//cout << "Position : Velocity " << endl;
-		simit::FieldRef<simit_float,3> pos = 	
-			points.getField<simit_float,3>("position");
-		simit::FieldRef<simit_float,3> vel = 
-			points.getField<simit_float,3>("velocity");
+		FloatField<3> pos = 	
+			FloatField<3>::get(points, "position", precision);
 		simit::FieldRef<bool> pin = 
 			points.getField<bool>("pinned");
 
@@ -275,18 +919,15 @@ void SpringSystem::step() {
 			glColor3f(1.f,0.f,0.f);
 		else
 			glColor3f(0.f,0.f,0.f);
-			glVertex3f((pos.get(p)(0)-spacing/2)/spacing, 
-   					   (pos.get(p)(1)-spacing/2)/spacing, 
-					   (pos.get(p)(2)-spacing/2)/spacing);
+			glVertex3f((pos.get(p)[0]-spacing/2)/spacing, 
+   					   (pos.get(p)[1]-spacing/2)/spacing, 
+					   (pos.get(p)[2]-spacing/2)/spacing);
 		}
 		glEnd();
 
 		//DBG//cout << endl;
 		//DBG//cout << "Strain" << endl;
 
-		simit::FieldRef<simit_float,3> str = 
-			springs.getField<simit_float,3>("strain");
-
 		glColor3f(0.5f, 0.5f, 0.5f);
 		glLineWidth(2.f);
 		int springCounter = 0;
@@ -295,12 +936,12 @@ void SpringSystem::step() {
 			simit::ElementRef ep0 = springs.getEndpoint(s,0);
 			simit::ElementRef ep1 = springs.getEndpoint(s,1);
 			glBegin(GL_LINES);
-			glVertex3f((pos.get(ep0)(0)-spacing/2)/spacing, 
-						(pos.get(ep0)(1)-spacing/2)/spacing, 
-						(pos.get(ep0)(2)-spacing/2)/spacing);
-			glVertex3f((pos.get(ep1)(0)-spacing/2)/spacing, 
-						(pos.get(ep1)(1)-spacing/2)/spacing, 
-						(pos.get(ep1)(2)-spacing/2)/spacing);						
+			glVertex3f((pos.get(ep0)[0]-spacing/2)/spacing, 
+						(pos.get(ep0)[1]-spacing/2)/spacing, 
+						(pos.get(ep0)[2]-spacing/2)/spacing);
+			glVertex3f((pos.get(ep1)[0]-spacing/2)/spacing, 
+						(pos.get(ep1)[1]-spacing/2)/spacing, 
+						(pos.get(ep1)[2]-spacing/2)/spacing);						
 			glEnd();
 			//DBG//cout << pos.get(ep0) << ", " << pos.get(ep1) << endl;
 			//DBG//cout << str.get(s) << endl;
@@ -319,6 +960,341 @@ void SpringSystem::step() {
  
 }
 
+double SpringSystem::systemEnergy() {
+
+	double energy = 0.0;
+	for (size_t i = 0; i < instances.size(); i++)
+		energy += instanceEnergy(i);
+	return layer ? layer->sum(energy) : energy;
+}
+
+double SpringSystem::instanceEnergy(size_t instance) {
+
+	FloatField<3> position = FloatField<3>::get(points, "position", precision);
+	FloatField<3> velocity = FloatField<3>::get(points, "velocity", precision);
+	FloatField<> mass = FloatField<>::get(points, "mass", precision);
+	FloatField<> k = FloatField<>::get(springs, "k", precision);
+	FloatField<> L_0 = FloatField<>::get(springs, "L_0", precision);
+	simit::FieldRef<bool> pinned = points.getField<bool>("pinned");
+
+	// accumulate in double whatever the program's precision
+	FloatExtern<3>::Value g = gravity.get();
+	double energy = 0.0;
+	size_t nv = mesh.v.size();
+	for (size_t i = instance*nv; i < (instance+1)*nv; i++) {
+		simit::ElementRef p = pointRefs[i];
+		if (pinned.get(p) || !owns(i - instance*nv))
+			continue;
+		FloatField<3>::Value x = position.get(p);
+		FloatField<3>::Value v = velocity.get(p);
+		double m = mass.get(p);
+		energy += 0.5 * m * (v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+		energy -= m * (g[0]*x[0] + g[1]*x[1] + g[2]*x[2]);
+	}
+	size_t ne = mesh.edges.size();
+	for (size_t i = instance*ne; i < (instance+1)*ne; i++) {
+		// a cut spring is counted by the owner of its first endpoint
+		if (!owns(mesh.edges[i - instance*ne][0]-1))
+			continue;
+		simit::ElementRef s = springRefs[i];
+		FloatField<3>::Value pA = position.get(springs.getEndpoint(s,0));
+		FloatField<3>::Value pB = position.get(springs.getEndpoint(s,1));
+		double L2 = (pA[0]-pB[0])*(pA[0]-pB[0]) +
+					(pA[1]-pB[1])*(pA[1]-pB[1]) +
+					(pA[2]-pB[2])*(pA[2]-pB[2]);
+		double L0 = L_0.get(s);
+		double strain = (L2 - L0*L0)/(L0*L0*2.0);
+		energy += 0.5 * k.get(s) * strain*strain;
+	}
+	return energy;
+}
+
+void SpringSystem::reportInstances() {
+
+	FloatField<3> position = FloatField<3>::get(points, "position", precision);
+	FloatField<3> velocity = FloatField<3>::get(points, "velocity", precision);
+
+	cout << "instance k damping h energy centroid_y max_speed" << endl;
+	size_t nv = mesh.v.size();
+	for (size_t i = 0; i < instances.size(); i++) {
+		double centroidY = 0.0;
+		double maxSpeed = 0.0;
+		for (size_t j = i*nv; j < (i+1)*nv; j++) {
+			FloatField<3>::Value v = velocity.get(pointRefs[j]);
+			centroidY += position.get(pointRefs[j])[1];
+			maxSpeed = max(maxSpeed, sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]));
+		}
+		cout << i << " " << instances[i].k << " " << instances[i].damping
+			 << " " << instances[i].h << " " << instanceEnergy(i) << " "
+			 << centroidY/nv << " " << maxSpeed << endl;
+	}
+}
+
+void SpringSystem::setParams(size_t instance, const SpringParams& params) {
+
+	instances[instance] = params;
+	if (pointRefs.empty())
+		return;
+
+	// rewrite the instance's fields or the bound extern in place, the
+	// compiled Function reads them at its next run() so nothing is
+	// recompiled
+	if (perInstance) {
+		FloatField<> h = FloatField<>::get(points, "h", precision);
+		FloatField<> damping = FloatField<>::get(points, "damping", precision);
+		size_t nv = mesh.v.size();
+		for (size_t i = instance*nv; i < (instance+1)*nv; i++) {
+			h.set(pointRefs[i], params.h);
+			damping.set(pointRefs[i], params.damping);
+		}
+	} else {
+		parameters.set({{params.h, params.damping}});
+	}
+	FloatField<> k = FloatField<>::get(springs, "k", precision);
+	size_t ne = mesh.edges.size();
+	for (size_t i = instance*ne; i < (instance+1)*ne; i++)
+		k.set(springRefs[i], params.k);
+	if (compacted)
+		compactSets();
+}
+
+bool SpringSystem::setParameter(const string& name, double value) {
+
+	if (name == "gravity") {
+		gravity.set({{0.0, -value, 0.0}});
+		return true;
+	}
+	if ((name == "contactk") || (name == "thickness") || (name == "ground")) {
+		if (name == "contactk")
+			contactParams.stiffness = value;
+		else if (name == "thickness")
+			contactParams.thickness = value;
+		else
+			contactParams.ground = value;
+		if (contacts)
+			contacts->setParams(contactParams);
+		return true;
+	}
+	if ((name == "sleepspeed") || (name == "sleepchecks")) {
+		if (name == "sleepspeed")
+			sleepSpeed = value;
+		else
+			sleepChecks = max(1, (int)value);
+		sleep.setLimits(sleepSpeed, sleepChecks);
+		return true;
+	}
+
+	if (instances.empty())
+		instances.push_back(defaultParams);
+	for (size_t i = 0; i < instances.size(); i++) {
+		SpringParams params = instances[i];
+		if (name == "k")
+			params.k = value;
+		else if (name == "damping")
+			params.damping = value;
+		else if (name == "h")
+			params.h = value;
+		else {
+			cerr << "Unknown parameter " << name << endl;
+			return false;
+		}
+		setParams(i, params);
+	}
+	return true;
+}
+
+bool SpringSystem::loadSweep(const char * file_name) {
+
+	// one instance per line: k damping h
+	ifstream in(file_name);
+	if (!in) {
+		cerr << "Unable to open " << file_name << endl;
+		return false;
+	}
+	SpringParams params;
+	instances.clear();
+	while (in >> params.k >> params.damping >> params.h)
+		instances.push_back(params);
+	cout << "Number of instances loaded: " << instances.size() << endl;
+	return !instances.empty();
+}
+
+void SpringSystem::bench(int numSteps) {
+
+	// the arenas only serve the benchmarked steps
+	StepArena::enable(true);
+	double startEnergy = systemEnergy();
+
+	// main from the same state first, for the native engine to match
+	double referenceMs = native ? referenceRun(numSteps) : 0.0;
+	nativeTime = 0.0;
+
+	contactTime = 0.0;
+	size_t rebuildsBefore = contact ? contacts->rebuilds() : 0;
+	haloTime = 0.0;
+	if (profiling) {
+		stepCounters.open();
+		if (contact) {
+			moveCounters.open();
+			contactCounters.open();
+			contacts->openCounters();
+		}
+	}
+	stepCounters.reset();
+	moveCounters.reset();
+	contactCounters.reset();
+	if (contact)
+		contacts->resetCounters();
+
+	// the first step sizes the arenas, the others should not allocate
+	size_t heapBefore = 0;
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < numSteps; i++) {
+		size_t active = sleep.activeElements();
+		auto stepStart = chrono::steady_clock::now();
+		advance();
+		if (sleeping)
+			sleep.addStep(active, chrono::duration<double,milli>(
+							  chrono::steady_clock::now() - stepStart).count());
+		if (i == 0)
+			heapBefore = StepArena::heapAllocations();
+	}
+	double ms = chrono::duration<double,milli>(
+					chrono::steady_clock::now() - start).count();
+	StepArena::enable(false);
+	size_t heapAllocations = StepArena::heapAllocations() - heapBefore;
+
+	double endEnergy = systemEnergy();
+
+	// position, velocity, mass, and in a sweep h and damping, per point
+	// and k, L_0, strain per spring,
+	// each read or written at least once per step
+	int fb = floatBytes(precision);
+	double pointFloats = perInstance ? 9.0 : 7.0;
+	double stateBytes = points.getSize() * (pointFloats*fb + sizeof(bool)) +
+						springs.getSize() * 3.0*fb;
+
+	// a partitioned step takes as long as its slowest rank; ghosts count
+	// towards the state but cut springs only once towards the rate
+	double springCount = springs.getSize();
+	if (layer) {
+		size_t owned = 0;
+		for (auto e : mesh.edges)
+			owned += owns(e[0]-1);
+		springCount = layer->sum(owned);
+		stateBytes = layer->sum(stateBytes);
+		double localMs = ms;
+		ms = layer->max(localMs);
+		double halo = layer->max(haloTime);
+		double largest = layer->max(points.getSize());
+		if (numaAware)
+			countLocalPages();
+		double pages = layer->sum(numaPages);
+		double localPages = layer->sum(numaLocal);
+		if (layer->rank() != 0)
+			return;
+		cout << "Partitions: " << layer->size() << ", largest "
+			 << largest << " points with ghosts, halo exchange "
+			 << halo/numSteps << " ms/step on the slowest rank" << endl;
+		if (numaAware)
+			cout << "NUMA: " << layer->size() << " ranks on " << numa.nodes()
+				 << " nodes, " << localPages << " of " << pages << " pages of"
+				 << " position, velocity and contact on their rank's node"
+				 << endl;
+
+		// ranks that share a core time-slice, so their step time says
+		// nothing about how the partitioned mode scales
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		if (cores < (long)layer->size())
+			cout << "Cores: " << cores << " online for " << layer->size()
+				 << " ranks; the ranks share cores, this is not a scaling"
+				 << " result" << endl;
+	}
+
+	cout << "Precision: " << ((precision == SinglePrecision) ?
+			"float32" : "double") << endl;
+	cout << "Instances: " << instances.size() << endl;
+	cout << "Steps: " << numSteps << ", " << ms/numSteps << " ms/step, "
+		 << springCount*numSteps/(ms*1e3) << " Msprings/s" << endl;
+	cout << "State: " << stateBytes/1e6 << " MB, "
+		 << stateBytes*numSteps/(ms*1e6) << " GB/s lower bound" << endl;
+	cout << "Energy: " << startEnergy << " -> " << endEnergy
+		 << ", drift " << (endEnergy - startEnergy)/fabs(startEnergy)
+		 << " (includes damping)" << endl;
+	if (contact)
+		cout << "Contact: " << contactTime/numSteps << " ms/step, "
+			 << 100.0*contactTime/ms << "% of the step, "
+			 << contacts->candidates() << " candidates, "
+			 << contacts->contacts() << " contacts in the last instance, "
+			 << contacts->rebuilds() - rebuildsBefore << " hash rebuilds"
+			 << endl;
+	cout << "Allocations: " << heapAllocations << " by the procs from the "
+		 << "heap in the last " << numSteps-1 << " steps, arena "
+		 << stepArena.capacity() + moveArena.capacity() << " bytes, "
+		 << stepArena.outlived() + moveArena.outlived()
+		 << " blocks outlived their step" << endl;
+	// simit fuses the maps of a proc into one function, so a proc run is
+	// the finest unit the host can count
+	if (profiling) {
+		stepCounters.report(cout, native ? "native" :
+							contact ? "forces" : "main", springs.getSize(),
+							"spring", numSteps);
+		if (contact) {
+			moveCounters.report(cout, "move", points.getSize(), "point",
+								numSteps);
+			// the calling thread is worker 0, the others count apart
+			contacts->addCounters(contactCounters);
+			contactCounters.report(cout, "contact", points.getSize(),
+								   "point", numSteps);
+		}
+	}
+	if (native) {
+		// differences relative to the size of the mesh
+		double lo[3], hi[3];
+		for (int d = 0; d < 3; d++) {
+			lo[d] = numeric_limits<double>::infinity();
+			hi[d] = -lo[d];
+		}
+		for (auto v : mesh.v)
+			for (int d = 0; d < 3; d++) {
+				lo[d] = min<double>(lo[d], v[d]);
+				hi[d] = max<double>(hi[d], v[d]);
+			}
+		double size = sqrt((hi[0]-lo[0])*(hi[0]-lo[0]) +
+						   (hi[1]-lo[1])*(hi[1]-lo[1]) +
+						   (hi[2]-lo[2])*(hi[2]-lo[2]));
+		double maxDiff = 0.0;
+		for (size_t i = 0; i < pointRefs.size(); i++) {
+			FloatField<3>::Value x = positionField.get(pointRefs[i]);
+			const FloatField<3>::Value& r = referencePosition[i];
+			maxDiff = max(maxDiff, sqrt((x[0]-r[0])*(x[0]-r[0]) +
+										(x[1]-r[1])*(x[1]-r[1]) +
+										(x[2]-r[2])*(x[2]-r[2])));
+		}
+		cout << "Native: " << nativeTime/numSteps << " ms/step stepping, "
+			 << (ms - nativeTime)/numSteps << " ms/step writing the fields; "
+			 << "main " << referenceMs/numSteps << " ms/step, "
+			 << referenceMs/nativeTime << "x; positions within "
+			 << maxDiff/max(size, 1e-300) << " of the mesh size of main's"
+			 << endl;
+	}
+	if (sleeping) {
+		cout << "Awake: " << sleep.awake().size() << " of "
+			 << points.getSize() << " points, " << sleep.activeElements()
+			 << " of " << springs.getSize() << " springs stepped at the"
+			 << " last check" << endl;
+		sleep.reportSteps(cout);
+	}
+
+	if (memoryReport) {
+		reportMemory("after stepping");
+		memory.fits(cout, pointRefs.size(), "point");
+	}
+
+	if (instances.size() > 1)
+		reportInstances();
+}
+
 bool SpringSystem::loadObject(const char * file_name) {
 
     //check if the file opens
@@ -326,6 +1302,27 @@ bool SpringSystem::loadObject(const char * file_name) {
     if ( !file_name ) {
         return false;
     }
+    if (MeshGenerator::isSpec(file_name))
+        return generateMesh(file_name);
+
+    // a valid binary cache skips parsing and the rest length pass
+    auto start = chrono::steady_clock::now();
+    MeshCache cache;
+    vector<double> unused;
+    if (cache.open(file_name, MeshCache::Springs) &&
+        cache.read(mesh, restLength, unused)) {
+        cout << "Number of vertices loaded: " << mesh.v.size() << endl;
+        cout << "Number of edges loaded: " << mesh.edges.size() << endl;
+        cout << "Loaded "
+             << MeshCache::cachePath(file_name, MeshCache::Springs) << " in "
+             << chrono::duration<double,milli>(
+                    chrono::steady_clock::now() - start).count()
+             << " ms" << endl;
+        return true;
+    }
+    // a cache with bad indices may have been copied out partly
+    mesh.v.clear();
+    mesh.edges.clear();
 
     // open file
     FILE *fp = fopen( file_name, "r" );
@@ -336,7 +1333,7 @@ bool SpringSystem::loadObject(const char * file_name) {
 
 	float x_temp, y_temp, z_temp;
 	int a,b,c;
-	char* type;
+	char type[256];
 	int faceCount = 0;
 	int EOFp;
 
@@ -360,10 +1357,63 @@ bool SpringSystem::loadObject(const char * file_name) {
 		EOFp = fscanf( fp, "%s", type ); 
  	}
  
+	fclose(fp);
+ 
 	cout << "Number of vertices loaded: " << mesh.v.size() << endl;
 	cout << "Number of edges loaded: " << mesh.edges.size() << endl;
 	cout << "Number of faces loaded: " << faceCount << endl;
 
+	// rest lengths, cached together with the parsed mesh
+	restLength.resize(mesh.edges.size());
+	for (size_t i = 0; i < mesh.edges.size(); i++) {
+		std::array<double,3> pA = mesh.v[mesh.edges[i][0]-1];
+		std::array<double,3> pB = mesh.v[mesh.edges[i][1]-1];
+		restLength[i] = sqrt((pA[0]-pB[0])*(pA[0]-pB[0]) +
+							 (pA[1]-pB[1])*(pA[1]-pB[1]) +
+							 (pA[2]-pB[2])*(pA[2]-pB[2]));
+	}
+	if (!MeshCache::write(file_name, MeshCache::Springs, mesh, restLength,
+						  vector<double>()))
+		cerr << "Unable to write "
+			 << MeshCache::cachePath(file_name, MeshCache::Springs) << endl;
+
+	return true;
+}
+
+bool SpringSystem::generateMesh(const char * spec) {
+
+	// unit cells, and a size given as one number counts springs, three
+	// per triangle
+	auto start = chrono::steady_clock::now();
+	MeshGenerator generator(1);
+	if (!generator.generate(spec, 1.0, 3, mesh)) {
+		cerr << "Unable to generate " << spec << ", expected grid:NXxNY,"
+			 << " lattice:NXxNYxNZ, grid:N or lattice:N" << endl;
+		return false;
+	}
+	generator.restLengths(mesh, restLength);
+
+	cout << "Number of vertices generated: " << mesh.v.size() << endl;
+	cout << "Number of edges generated: " << mesh.edges.size() << endl;
+	cout << "Generated " << spec << " in "
+		 << chrono::duration<double,milli>(
+				chrono::steady_clock::now() - start).count()
+		 << " ms" << endl;
 	return true;
 }
 
+void SpringSystem::subdivide(int levels) {
+
+	auto start = chrono::steady_clock::now();
+	MeshGenerator generator(1);
+	generator.subdivide(levels, mesh);
+	generator.restLengths(mesh, restLength);
+
+	cout << "Number of vertices after " << levels << " subdivisions: "
+		 << mesh.v.size() << endl;
+	cout << "Number of edges after " << levels << " subdivisions: "
+		 << mesh.edges.size() << endl;
+	cout << "Subdivided in " << chrono::duration<double,milli>(
+									chrono::steady_clock::now() - start).count()
+		 << " ms" << endl;
+}
@@ -6,26 +6,211 @@
 #include "error.h"
 #include "function.h"
 #include "mesh.h"
+#include "FloatField.h"
+#include "MemoryReport.h"
+#include "ContactStage.h"
+#include "MessageLayer.h"
+#include "NativeEngine.h"
+#include "NumaTopology.h"
+#include "PerfCounters.h"
+#include "SleepTracker.h"
+#include "StateExport.h"
+#include "Trajectory.h"
+#include "StepArena.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <vector>
+
+// Physical parameters of one simulated instance. A parameter sweep
+// replicates the mesh once per instance, see SpringSystem::loadSweep.
+struct SpringParams
+{
+    double k;		// spring constant
+    double damping;	// velocity damping coefficient
+    double h;		// time step
+};
 
 class SpringSystem
 {
 public:
     
     SpringSystem();
+	void setPrecision(Precision p) { precision = p; }
+	void setContact(bool c) { contact = c; }
+	void setSleeping(bool s) { sleeping = s; }
+	void setNuma(bool n) { numaAware = n; }
+	void setNative(bool n) { nativeEngine = n; }
+	void setProfiling(bool p) { profiling = p; }
+	void setMemoryReport(bool m) { memoryReport = m; }
+	void setExport(const std::string& name, int interval) {
+		exportName = name;
+		exportInterval = std::max(interval, 1);
+	}
+	void setRecord(const std::string& path, int interval) {
+		recordPath = path;
+		exportInterval = std::max(interval, 1);
+	}
+	void compile();
 	void load();
+	void advance();
 	void step();
+	void bench(int numSteps);
+	double systemEnergy();
+	double instanceEnergy(size_t instance);
+	void reportInstances();
+	// file_name may also be a MeshGenerator spec such as grid:100x100
 	bool loadObject(const char * file_name);
+	void subdivide(int levels);
+	bool loadSweep(const char * file_name);
+
+	// Splits the loaded mesh into parts and forks one process per part
+	// after the first; each continues with its own part and rank.
+	bool partition(int parts);
+	void joinPartitions();
+
+	// Parameter updates between run() calls. These write fields and bound
+	// externs in place and never recompile the program.
+	void setParams(size_t instance, const SpringParams& params);
+	bool setParameter(const std::string& name, double value);
 	void update_angle();
     
 protected:
 
     simit::MeshVol mesh;   
+    std::vector<double> restLength;	// per mesh edge, from loadObject
+    bool generateMesh(const char * spec);
+    Precision precision;
     simit::Set points;
     simit::Set springs;
+    std::vector<SpringParams> instances;	// empty means one default instance
+    std::vector<simit::ElementRef> pointRefs;	// mesh vertex x instance
+    std::vector<simit::ElementRef> springRefs;	// mesh edge x instance
     simit::Program program;
     simit::Function timeStepper;
+    StepArena stepArena;		// temporaries of timeStepper.run()
+    FloatExtern<3> gravity;
+    // a sweep keeps h and damping per point, a single instance binds them
+    // as the parameters extern, see compile()
+    bool perInstance;
+    FloatExtern<2> parameters;		// h, damping
+
+    // With contact on, a step is move, the host contact stage on the new
+    // positions, then forces, instead of the single main proc.
+    void collide();
+    bool contact;
+    simit::Function positionUpdate;
+    StepArena moveArena;
+
+    // handles of the fields the host reads or writes every step, kept so
+    // that a steady step does not allocate them again
+    FloatField<3> positionField;
+    FloatField<3> velocityField;
+    FloatField<3> contactField;
+    std::unique_ptr<ContactStage> contacts;
+    ContactParams contactParams;	// NaN thickness or ground means automatic
+    std::vector<ContactStage::Vec3> contactX;	// one instance, reused
+    std::vector<ContactStage::Vec3> contactF;
+    double contactTime;			// ms spent in collide()
+
+    // Every sleepInterval steps, points that stayed calm for sleepChecks
+    // checks in a row go to sleep and moving points wake their sleeping
+    // neighbours, see settle(). While any point sleeps, the procs run on
+    // compacted copies of the active springs and the points they touch,
+    // rebuilt by compactSets() only when a point falls asleep or wakes;
+    // the full sets keep the sleeping state and get the awake points'
+    // position and velocity back after every run.
+    void settle();
+    void compactSets();
+    void bindSets(simit::Set& stepPoints, simit::Set& stepSprings);
+    void scatter();
+    double meanRestLength() const;
+    bool sleeping;
+    double sleepSpeed;			// NaN means automatic
+    int sleepChecks;
+    int stepCount;
+    SleepTracker sleep;
+    bool compacted;				// procs bound to the awake sets
+    std::unique_ptr<simit::Set> awakePoints;
+    std::unique_ptr<simit::Set> awakeSprings;	// (awakePoints, awakePoints)
+    std::vector<simit::ElementRef> awakePointRefs;
+    std::vector<size_t> activePoints;	// awake set index -> full index
+    std::vector<size_t> activeSprings;
+    std::vector<int> compactOf;		// full -> awake set index, or -1
+    FloatField<3> awakePosition;
+    FloatField<3> awakeVelocity;
+    FloatField<3> awakeContact;
+
+    // partitioned run: the mesh members hold this rank's part, its owned
+    // vertices first and then its ghosts, which exchangeHalo() overwrites
+    // with the owners' values after every step
+    void exchangeHalo();
+    bool owns(size_t vertex) const { return !layer || vertex < ownedPoints; }
+    std::unique_ptr<MessageLayer> layer;
+    std::vector<int> globalIds;		// local vertex -> vertex of the whole mesh
+    size_t ownedPoints;
+    std::vector<int> sendLocal;		// owned vertices other parts ghost
+    std::vector<int> sendGlobal;
+    std::vector<int> ghostLocal;
+    std::vector<int> ghostGlobal;
+    std::vector<double> haloValues;	// position and velocity per point
+    std::vector<pid_t> children;
+    double haloTime;				// ms spent in exchangeHalo()
+
+    // NUMA mode, one rank per node on top of the partitioned run: each
+    // rank is pinned to a node before it fills its sets, so their pages
+    // are first touched there, and simit's maps, which run on the rank's
+    // calling thread, stay on that node.
+    void countLocalPages();
+    bool numaAware;
+    NumaTopology numa;
+    size_t numaPages;				// pages of the vector fields
+    size_t numaLocal;				// of those, on the rank's node
+
+    // hardware counters in bench(), per phase of a step; collide() counts
+    // its calling thread, worker 0 of the contact stage, and adds the
+    // stage's other workers before the report
+    bool profiling;
+    PerfCounters stepCounters;		// main, or forces with contact
+    PerfCounters moveCounters;
+    PerfCounters contactCounters;
+
+    // bytes by set, field and temporaries after load, after init and at
+    // the end of bench()
+    void reportMemory(const std::string& phase);
+    bool memoryReport;
+    MemoryReport memory;
+
+    // the spring connectivity once and the positions every exportInterval
+    // steps in shared memory, for viewers in other processes, and to a
+    // trajectory file, for FrameRenderer
+    void exportState();
+    std::string exportName;		// empty means no export
+    int exportInterval;
+    std::unique_ptr<StateExport> exporter;
+    std::string recordPath;		// empty means no trajectory
+    std::unique_ptr<TrajectoryWriter> recorder;
+    std::vector<float> exportPositions;
+    uint64_t exportSteps;		// since load()
+    double exportTime;			// simulated, of the first instance
+
+    // --native: main stepped by NativeEngine instead of the program, with
+    // position and velocity written back to the fields after every step;
+    // bench() first runs main from the same state to validate it
+    void loadNative();
+    void nativeStep();
+    double referenceRun(int numSteps);
+    bool nativeEngine;
+    std::unique_ptr<NativeStepper> native;
+    double nativeTime;			// ms spent in native->step()
+    std::vector<FloatField<3>::Value> referencePosition;
+
+    std::future<void> compiled;	// set by compile(), waited on in load()
+    double compileTime;
+    std::chrono::steady_clock::time_point startupBegin;
     
 };
 
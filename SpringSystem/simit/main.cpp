@@ -1,14 +1,170 @@
-#include "SpringSystem.h"
 
+#include "SpringSystem.h"
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
 
+using namespace std;
 
+/* SpringSystem <mesh> <backend> [options]
+ *   mesh           an OBJ file, or a mesh generated in memory: grid:NXxNY
+ *                  (planar, two triangles per cell), lattice:NXxNYxNZ
+ *                  (every square of a cubic lattice braced), or grid:N,
+ *                  lattice:N for about N springs
+ *   --subdivide L  split every triangle into four, L times
+ *   --float32      run the program and store its fields in float32; only
+ *                  the host's energy reports accumulate in double
+ *   --bench N      run N steps without the viewer and report timings
+ *   --sweep FILE   batch one instance per line of FILE ("k damping h")
+ *                  into the same sets and report per-instance results
+ *   --set NAME=VAL set k, damping, h or gravity without recompiling,
+ *                  contactk, thickness and ground of the contact stage, or
+ *                  sleepspeed and sleepchecks of --sleep
+ *   --contact      add ground and self-contact forces between steps
+ *   --sleep        put settled points to sleep and step only the springs
+ *                  with an awake point, in sets rebuilt when one sleeps
+ *                  or wakes
+ *   --native       step main with the hand-written NativeEngine, not with
+ *                  --contact or --sleep; with --bench, run main from the
+ *                  same state first and report both step times and the
+ *                  difference in positions
+ *   --numa         with --partitions K, pin rank r to NUMA node
+ *                  r*nodes/K before it fills its sets, so K equal to the
+ *                  number of nodes runs one rank per node; needs
+ *                  --partitions
+ *   --counters     with --bench, report hardware counters (IPC, LLC and
+ *                  branch misses per element) of each phase of a step
+ *   --memory       report bytes per set, field and temporaries with the
+ *                  process RSS after load, after init and after --bench
+ *   --export NAME  publish the springs once and the positions every 10
+ *                  steps as POSIX shared memory /NAME, see StateReader
+ *   --record FILE  write the springs once and the positions every 10
+ *                  steps to the trajectory FILE, see FrameRenderer
+ *   --export-interval N  publish or record every N steps instead
+ *   --partitions K split the mesh into K parts, each stepped by its own
+ *                  process with halos exchanged in shared memory; needs
+ *                  --bench and one instance, no --contact, --sleep,
+ *                  --export, --record or --native
+ */
 int main(int argc, char **argv) {
 
-        simit::init(argv[2], sizeof(simit_float));
+        Precision precision = DoublePrecision;
+        bool contact = false;
+        bool sleeping = false;
+        bool numaAware = false;
+        bool native = false;
+        bool profiling = false;
+        bool memoryReport = false;
+        const char* exportName = NULL;
+        const char* recordPath = NULL;
+        int exportInterval = 10;
+        int partitions = 1;
+        int benchSteps = 0;
+        int subdivisions = 0;
+        const char* sweep = NULL;
+        vector<char*> settings;
+        vector<char*> args;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--float32") == 0)
+                precision = SinglePrecision;
+            else if (strcmp(argv[i], "--contact") == 0)
+                contact = true;
+            else if (strcmp(argv[i], "--sleep") == 0)
+                sleeping = true;
+            else if (strcmp(argv[i], "--native") == 0)
+                native = true;
+            else if (strcmp(argv[i], "--numa") == 0)
+                numaAware = true;
+            else if (strcmp(argv[i], "--counters") == 0)
+                profiling = true;
+            else if (strcmp(argv[i], "--memory") == 0)
+                memoryReport = true;
+            else if ((strcmp(argv[i], "--export") == 0) && (i+1 < argc))
+                exportName = argv[++i];
+            else if ((strcmp(argv[i], "--record") == 0) && (i+1 < argc))
+                recordPath = argv[++i];
+            else if ((strcmp(argv[i], "--export-interval") == 0) &&
+                     (i+1 < argc))
+                exportInterval = atoi(argv[++i]);
+            else if ((strcmp(argv[i], "--partitions") == 0) && (i+1 < argc))
+                partitions = atoi(argv[++i]);
+            else if ((strcmp(argv[i], "--subdivide") == 0) && (i+1 < argc))
+                subdivisions = atoi(argv[++i]);
+            else if ((strcmp(argv[i], "--bench") == 0) && (i+1 < argc))
+                benchSteps = atoi(argv[++i]);
+            else if ((strcmp(argv[i], "--sweep") == 0) && (i+1 < argc))
+                sweep = argv[++i];
+            else if ((strcmp(argv[i], "--set") == 0) && (i+1 < argc))
+                settings.push_back(argv[++i]);
+            else
+                args.push_back(argv[i]);
+        }
+        bool partitioned = (partitions > 1);
+        if ((args.size() < 2) || (native && (contact || sleeping)) ||
+            (numaAware && !partitioned) ||
+            (partitioned && ((benchSteps <= 0) || sweep || contact ||
+                             sleeping || exportName || recordPath ||
+                             native))) {
+            std::cerr << "usage: " << argv[0]
+                      << " <mesh.obj | grid:NXxNY | lattice:NXxNYxNZ> <backend>"
+                      << " [--subdivide L] [--float32] [--bench N]"
+                      << " [--sweep FILE] [--set NAME=VAL] [--contact]"
+                      << " [--sleep] [--native] [--counters]"
+                      << " [--memory]"
+                      << " [--export NAME] [--record FILE]"
+                      << " [--export-interval N]"
+                      << " [--partitions K [--numa]]"
+                      << std::endl;
+            return 1;
+        }
+
+        simit::init(args[1], floatBytes(precision));
         SpringSystem t;
-        if (t.loadObject(argv[1])) {
+        t.setPrecision(precision);
+        t.setContact(contact);
+        t.setSleeping(sleeping);
+        t.setNuma(numaAware);
+        t.setNative(native);
+        t.setProfiling(profiling);
+        t.setMemoryReport(memoryReport);
+        if (exportName)
+            t.setExport(string("/") + exportName, exportInterval);
+        if (recordPath)
+            t.setRecord(recordPath, exportInterval);
+        if (sweep && !t.loadSweep(sweep))
+            return 1;
+        for (char* setting : settings) {
+            char* value = strchr(setting, '=');
+            if (!value)
+                return 1;
+            *value++ = '\0';
+            if (!t.setParameter(setting, atof(value)))
+                return 1;
+        }
+        if (partitioned) {
+            // every rank compiles for its own part, so the mesh is split
+            // and the ranks forked before the compile thread starts
+            if (!t.loadObject(args[0]))
+                return 1;
+            if (subdivisions > 0)
+                t.subdivide(subdivisions);
+            if (!t.partition(partitions))
+                return 1;
+            t.compile();
+            t.load();
+            t.bench(benchSteps);
+            t.joinPartitions();
+            return 0;
+        }
+        t.compile();
+        if (t.loadObject(args[0])) {
+	        if (subdivisions > 0)
+	            t.subdivide(subdivisions);
 	        t.load();
-    	    t.step();
+	        if (benchSteps > 0)
+	            t.bench(benchSteps);
+	        else
+    	        t.step();
     	}
     
 }
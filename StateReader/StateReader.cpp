@@ -0,0 +1,93 @@
+#include "StateExport.h"
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <thread>
+
+using namespace std;
+
+/* StateReader <name> [seconds]
+ *
+ * Attaches to the state a SpringSystem or Elastic2D run exports with
+ * --export <name> and reports once a second how many frames arrived, how
+ * many were overwritten before they could be read, their age, and the
+ * simulation's step rate. Stops when the run ends or after the given
+ * seconds. Reading never slows the writer down, so any number of these
+ * may run at once.
+ */
+int main(int argc, char **argv) {
+
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <name> [seconds]" << endl;
+        return 1;
+    }
+    string name = argv[1];
+    if (name[0] != '/')
+        name = "/" + name;
+    double seconds = (argc > 2) ? atof(argv[2]) : 0.0;
+
+    typedef chrono::steady_clock Clock;
+    auto begin = Clock::now();
+    auto elapsed = [&]() {
+        return chrono::duration<double>(Clock::now() - begin).count();
+    };
+
+    StateView view;
+    while (!view.attach(name)) {
+        if ((seconds > 0.0) && (elapsed() > seconds)) {
+            cerr << "no state exported as " << name << endl;
+            return 1;
+        }
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    cout << "Attached to " << name << ": " << view.points() << " points of "
+         << view.dims() << " floats, " << view.elements() << " elements of "
+         << view.arity() << " points" << endl;
+
+    StateFrame frame;
+    uint64_t last = 0;
+    uint64_t firstStep = 0;
+    double firstTime = 0.0;
+    bool first = true;
+    // per report interval
+    long received = 0, missed = 0;
+    double ageSum = 0.0, ageMax = 0.0;
+    uint64_t intervalStep = 0;
+    double intervalStart = elapsed();
+    while (view.writerAlive() && ((seconds <= 0.0) || (elapsed() < seconds))) {
+        if (view.read(frame, last)) {
+            if (first) {
+                firstStep = frame.step;
+                firstTime = frame.time;
+                intervalStep = frame.step;
+                first = false;
+            } else
+                missed += frame.frame - last - 1;
+            last = frame.frame;
+            received++;
+            ageSum += frame.age;
+            ageMax = max(ageMax, frame.age);
+        } else
+            this_thread::sleep_for(chrono::microseconds(200));
+
+        double now = elapsed();
+        if (now - intervalStart >= 1.0) {
+            double span = now - intervalStart;
+            cout << "Frames: " << received/span << "/s received, " << missed
+                 << " overwritten unread, age "
+                 << (received ? 1e3*ageSum/received : 0.0) << " ms mean, "
+                 << 1e3*ageMax << " ms max; step " << frame.step << ", "
+                 << (frame.step - intervalStep)/span << " steps/s" << endl;
+            received = missed = 0;
+            ageSum = ageMax = 0.0;
+            intervalStep = frame.step;
+            intervalStart = now;
+        }
+    }
+
+    if (!first)
+        cout << "Total: " << last << " frames published, steps " << firstStep
+             << " to " << frame.step << ", simulated " << frame.time - firstTime
+             << " s in " << elapsed() << " s" << endl;
+    return 0;
+}
@@ -0,0 +1,265 @@
+#ifndef _common_FloatField_h
+#define _common_FloatField_h
+
+#include "graph.h"
+#include "function.h"
+#include "tensor.h"
+#include <array>
+#include <memory>
+#include <string>
+
+/* Precision of the simulation, chosen at startup.
+ *
+ * simit compiles a program for one float type, passed to simit::init, and
+ * its fields must have that type. DoublePrecision runs the program and
+ * stores every field as simit_float; SinglePrecision does both in float32,
+ * which halves the bytes streamed per step but also makes every reduction,
+ * solve and energy inside the program float32. Only the host's own
+ * reports (energies, norms, diagnostics) read the fields back and
+ * accumulate in double. */
+enum Precision { DoublePrecision, SinglePrecision };
+
+// Size of the simit program's float type, passed to simit::init.
+inline int floatBytes(Precision precision) {
+    return (precision == SinglePrecision) ? (int)sizeof(float)
+                                         : (int)sizeof(simit_float);
+}
+
+template <int... dims> struct FieldSize;
+template <> struct FieldSize<> { static const int value = 1; };
+template <int d, int... ds> struct FieldSize<d, ds...> {
+    static const int value = d * FieldSize<ds...>::value;
+};
+
+/* A float field of a simit::Set whose element type follows the run's
+ * Precision. Values cross the host boundary as double. Matrix fields can
+ * be added but are only read and written by the simit program. */
+template <int... dims>
+class FloatField
+{
+public:
+
+    static const int size = FieldSize<dims...>::value;
+    typedef std::array<double,size> Value;
+
+    FloatField() : precision(DoublePrecision) {}
+
+    static FloatField add(simit::Set& set, const std::string& name,
+                          Precision precision) {
+        FloatField f;
+        f.precision = precision;
+        if (precision == SinglePrecision)
+            f.f32.reset(new simit::FieldRef<float,dims...>(
+                set.addField<float,dims...>(name)));
+        else
+            f.f64.reset(new simit::FieldRef<simit_float,dims...>(
+                set.addField<simit_float,dims...>(name)));
+        return f;
+    }
+
+    static FloatField get(simit::Set& set, const std::string& name,
+                          Precision precision) {
+        FloatField f;
+        f.precision = precision;
+        if (precision == SinglePrecision)
+            f.f32.reset(new simit::FieldRef<float,dims...>(
+                set.getField<float,dims...>(name)));
+        else
+            f.f64.reset(new simit::FieldRef<simit_float,dims...>(
+                set.getField<simit_float,dims...>(name)));
+        return f;
+    }
+
+    Value get(simit::ElementRef e) const {
+        Value v;
+        if (precision == SinglePrecision)
+            read(*f32, e, v);
+        else
+            read(*f64, e, v);
+        return v;
+    }
+
+    void set(simit::ElementRef e, const Value& v) {
+        if (precision == SinglePrecision)
+            write(*f32, e, v);
+        else
+            write(*f64, e, v);
+    }
+
+    // Bytes one element of this field occupies in the set.
+    int bytes() const {
+        return size * ((precision == SinglePrecision) ? sizeof(float)
+                                                     : sizeof(simit_float));
+    }
+
+    // Address of e's values. A field stores its elements in set order, so
+    // a range of elements is one contiguous block, e.g. for page placement.
+    const void* address(simit::ElementRef e) const {
+        if (precision == SinglePrecision)
+            return &f32->get(e)(0);
+        return &f64->get(e)(0);
+    }
+
+    // Values of the count elements from first on, in set order, copied
+    // straight from or to the field's block instead of element by element.
+    void getRange(simit::ElementRef first, size_t count, Value* out) const {
+        if (count == 0)
+            return;
+        if (precision == SinglePrecision)
+            copyOut(&f32->get(first)(0), count, out);
+        else
+            copyOut(&f64->get(first)(0), count, out);
+    }
+
+    void setRange(simit::ElementRef first, size_t count, const Value* in) {
+        if (count == 0)
+            return;
+        if (precision == SinglePrecision)
+            copyIn(in, count, &f32->get(first)(0));
+        else
+            copyIn(in, count, &f64->get(first)(0));
+    }
+
+private:
+
+    template <typename T>
+    static void copyOut(const T* block, size_t count, Value* out) {
+        for (size_t e = 0; e < count; e++)
+            for (int i = 0; i < size; i++)
+                out[e][i] = block[e*size + i];
+    }
+
+    template <typename T>
+    static void copyIn(const Value* in, size_t count, T* block) {
+        for (size_t e = 0; e < count; e++)
+            for (int i = 0; i < size; i++)
+                block[e*size + i] = static_cast<T>(in[e][i]);
+    }
+
+    template <typename T>
+    static void read(simit::FieldRef<T,dims...>& f, simit::ElementRef e,
+                     Value& v) {
+        simit::TensorRef<T,dims...> r = f.get(e);
+        for (int i = 0; i < size; i++)
+            v[i] = r(i);
+    }
+
+    template <typename T>
+    static void write(simit::FieldRef<T,dims...>& f, simit::ElementRef e,
+                      const Value& v) {
+        simit::TensorRef<T,dims...> r = f.get(e);
+        for (int i = 0; i < size; i++)
+            r(i) = static_cast<T>(v[i]);
+    }
+
+    Precision precision;
+    std::shared_ptr<simit::FieldRef<float,dims...> > f32;
+    std::shared_ptr<simit::FieldRef<simit_float,dims...> > f64;
+};
+
+/* Scalar specialisation, simit stores these without a TensorRef. */
+template <>
+class FloatField<>
+{
+public:
+
+    FloatField() : precision(DoublePrecision) {}
+
+    static FloatField add(simit::Set& set, const std::string& name,
+                          Precision precision) {
+        FloatField f;
+        f.precision = precision;
+        if (precision == SinglePrecision)
+            f.f32.reset(new simit::FieldRef<float>(
+                set.addField<float>(name)));
+        else
+            f.f64.reset(new simit::FieldRef<simit_float>(
+                set.addField<simit_float>(name)));
+        return f;
+    }
+
+    static FloatField get(simit::Set& set, const std::string& name,
+                          Precision precision) {
+        FloatField f;
+        f.precision = precision;
+        if (precision == SinglePrecision)
+            f.f32.reset(new simit::FieldRef<float>(
+                set.getField<float>(name)));
+        else
+            f.f64.reset(new simit::FieldRef<simit_float>(
+                set.getField<simit_float>(name)));
+        return f;
+    }
+
+    double get(simit::ElementRef e) const {
+        return (precision == SinglePrecision) ? (double)f32->get(e)
+                                             : (double)f64->get(e);
+    }
+
+    void set(simit::ElementRef e, double v) {
+        if (precision == SinglePrecision)
+            f32->set(e, static_cast<float>(v));
+        else
+            f64->set(e, static_cast<simit_float>(v));
+    }
+
+    int bytes() const {
+        return (precision == SinglePrecision) ? sizeof(float)
+                                             : sizeof(simit_float);
+    }
+
+private:
+
+    Precision precision;
+    std::shared_ptr<simit::FieldRef<float> > f32;
+    std::shared_ptr<simit::FieldRef<simit_float> > f64;
+};
+
+/* A vector extern of the simit program, bound from the host, whose element
+ * type follows the run's Precision. The Function reads it through the bound
+ * pointer, so set() takes effect at the next run() without recompiling. */
+template <int n>
+class FloatExtern
+{
+public:
+
+    typedef std::array<double,n> Value;
+
+    FloatExtern() : precision(DoublePrecision) { value.fill(0.0); }
+
+    void bind(simit::Function& f, const std::string& name,
+              Precision p) {
+        precision = p;
+        if (precision == SinglePrecision) {
+            if (!t32)
+                t32.reset(new simit::Tensor<float,n>());
+            f.bind(name, t32.get());
+        } else {
+            if (!t64)
+                t64.reset(new simit::Tensor<simit_float,n>());
+            f.bind(name, t64.get());
+        }
+        set(value);
+    }
+
+    void set(const Value& v) {
+        value = v;
+        for (int i = 0; i < n; i++) {
+            if (t32)
+                (*t32)(i) = static_cast<float>(v[i]);
+            if (t64)
+                (*t64)(i) = static_cast<simit_float>(v[i]);
+        }
+    }
+
+    const Value& get() const { return value; }
+
+private:
+
+    Precision precision;
+    Value value;
+    std::shared_ptr<simit::Tensor<float,n> > t32;
+    std::shared_ptr<simit::Tensor<simit_float,n> > t64;
+};
+
+#endif
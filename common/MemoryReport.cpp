@@ -0,0 +1,141 @@
+#include "MemoryReport.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+using namespace std;
+
+static double megabytes(size_t bytes) {
+    return bytes / 1e6;
+}
+
+void MemoryReport::addSet(const string& set, size_t elements) {
+
+    for (Set& s : sets)
+        if (s.name == set) {
+            s.elements = elements;
+            return;
+        }
+    Set s = { set, elements };
+    sets.push_back(s);
+}
+
+void MemoryReport::addField(const string& set, const string& field,
+                            size_t bytesPerElement) {
+
+    Field f = { set, field, bytesPerElement };
+    fields.push_back(f);
+}
+
+void MemoryReport::setOther(const string& name, size_t bytes) {
+
+    for (Other& o : others)
+        if (o.name == name) {
+            o.bytes = bytes;
+            return;
+        }
+    Other o = { name, bytes };
+    others.push_back(o);
+}
+
+size_t MemoryReport::elementsOf(const string& set) const {
+
+    for (const Set& s : sets)
+        if (s.name == set)
+            return s.elements;
+    return 0;
+}
+
+size_t MemoryReport::setBytes() const {
+
+    size_t total = 0;
+    for (const Field& f : fields)
+        total += f.bytes * elementsOf(f.set);
+    return total;
+}
+
+size_t MemoryReport::otherBytes() const {
+
+    size_t total = 0;
+    for (const Other& o : others)
+        total += o.bytes;
+    return total;
+}
+
+void MemoryReport::print(ostream& out, const string& phase) const {
+
+    size_t rss = residentBytes();
+    size_t accounted = setBytes() + otherBytes();
+    out << "Memory " << phase << ": " << megabytes(setBytes())
+        << " MB in sets, " << megabytes(otherBytes())
+        << " MB temporaries and host buffers, RSS " << megabytes(rss)
+        << " MB (peak " << megabytes(peakResidentBytes()) << " MB, "
+        << megabytes(rss > accounted ? rss - accounted : 0)
+        << " MB code, libraries and allocator)" << endl;
+
+    for (const Set& s : sets) {
+        size_t bytes = 0;
+        for (const Field& f : fields)
+            if (f.set == s.name)
+                bytes += f.bytes * s.elements;
+        out << "  " << s.name << ": " << s.elements << " elements, "
+            << megabytes(bytes) << " MB" << endl;
+        for (const Field& f : fields)
+            if (f.set == s.name)
+                out << "    " << left << setw(16) << f.name << right
+                    << setw(6) << f.bytes << " B  "
+                    << megabytes(f.bytes * s.elements) << " MB" << endl;
+    }
+    for (const Other& o : others)
+        out << "  " << o.name << ": " << megabytes(o.bytes) << " MB" << endl;
+}
+
+void MemoryReport::fits(ostream& out, size_t count, const string& unit) const {
+
+    if (count == 0)
+        return;
+    double perUnit = (double)(setBytes() + otherBytes()) / count;
+    size_t available = availableBytes();
+    out << "Capacity: " << perUnit << " B per " << unit;
+    if (available > 0)
+        out << ", about " << (size_t)(available / perUnit) << " more "
+            << unit << "s fit in the " << megabytes(available)
+            << " MB available";
+    out << endl;
+}
+
+// the second field of /proc/self/statm, in pages
+size_t MemoryReport::residentBytes() {
+
+    ifstream in("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    if (!(in >> size >> resident))
+        return 0;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// "Key:   value kB" lines of /proc files such as /proc/self/status
+static size_t readKilobytes(const char* file, const string& key) {
+
+    ifstream in(file);
+    string line;
+    while (getline(in, line))
+        if (line.compare(0, key.size(), key) == 0) {
+            istringstream value(line.substr(key.size()));
+            size_t kb = 0;
+            value >> kb;
+            return kb * 1024;
+        }
+    return 0;
+}
+
+size_t MemoryReport::peakResidentBytes() {
+
+    return readKilobytes("/proc/self/status", "VmHWM:");
+}
+
+size_t MemoryReport::availableBytes() {
+
+    return readKilobytes("/proc/meminfo", "MemAvailable:");
+}
@@ -0,0 +1,69 @@
+#ifndef _common_MemoryReport_h
+#define _common_MemoryReport_h
+
+#include <iostream>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* Where the bytes of a run go: every field of every set, the endpoints of
+ * edge sets, the temporaries the compiled procs allocate per run (the
+ * most their StepArenas had out at once, and the rest of the arenas) and
+ * host buffers, next to the resident size of the process and its peak.
+ *
+ * Sets are described once with their fields' bytes per element; counts
+ * and the other entries are updated before each print(), so one report
+ * serves every phase. Everything except the resident sizes is linear in
+ * the mesh, which is what fits() extrapolates. */
+class MemoryReport
+{
+public:
+
+    void addSet(const std::string& set, size_t elements);
+    void addField(const std::string& set, const std::string& field,
+                  size_t bytesPerElement);
+    // Replaces the bytes of a named temporary or host buffer.
+    void setOther(const std::string& name, size_t bytes);
+
+    size_t setBytes() const;
+    size_t otherBytes() const;
+
+    // "Memory <phase>: ..." then one line per set, field and other entry.
+    void print(std::ostream& out, const std::string& phase) const;
+
+    // How many more of unit (e.g. mesh points) fit into the memory still
+    // available, if all accounted bytes scale with count of them.
+    void fits(std::ostream& out, size_t count, const std::string& unit) const;
+
+    // From /proc on Linux, 0 where unknown.
+    static size_t residentBytes();
+    static size_t peakResidentBytes();
+    static size_t availableBytes();
+
+private:
+
+    struct Set
+    {
+        std::string name;
+        size_t elements;
+    };
+    struct Field
+    {
+        std::string set;
+        std::string name;
+        size_t bytes;
+    };
+    struct Other
+    {
+        std::string name;
+        size_t bytes;
+    };
+
+    size_t elementsOf(const std::string& set) const;
+
+    std::vector<Set> sets;
+    std::vector<Field> fields;
+    std::vector<Other> others;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "MeshCache.h"
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char     cacheMagic[8] = {'S','I','M','E','S','H','\0','\0'};
+static const uint32_t cacheVersion  = 2;
+static const size_t   cacheAlign    = 64;
+
+struct MeshCache::Header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t layout;
+    uint32_t indexBase;
+    uint64_t sourceSize;
+    int64_t  sourceMtimeSec;
+    int64_t  sourceMtimeNsec;
+    uint64_t numVertices;
+    uint64_t numEdges;
+    uint64_t numEdgeRest;
+    uint64_t numFaceRest;
+    uint64_t verticesOffset;
+    uint64_t edgesOffset;
+    uint64_t edgeRestOffset;
+    uint64_t faceRestOffset;
+    uint64_t fileSize;
+};
+
+static uint64_t alignUp(uint64_t offset) {
+    return (offset + cacheAlign - 1) & ~(uint64_t)(cacheAlign - 1);
+}
+
+static bool statSource(const char * source, struct stat& st) {
+    return (source != NULL) && (stat(source, &st) == 0);
+}
+
+static int indexBase(MeshCache::Layout layout) {
+    return (layout == MeshCache::Springs) ? 1 : 0;
+}
+
+// count elements of size bytes at offset, aligned and inside length bytes
+static bool inside(uint64_t offset, uint64_t count, size_t size,
+                   size_t length) {
+    return (offset % cacheAlign == 0) && (offset <= length) &&
+           (count <= (length - offset) / size);
+}
+
+MeshCache::MeshCache() : data(NULL), length(0), header(NULL),
+    layout(Springs) {
+}
+
+MeshCache::~MeshCache() {
+    close();
+}
+
+string MeshCache::cachePath(const char * source, Layout layout) {
+    return string(source) +
+           ((layout == Springs) ? ".springs.cache" : ".triangles.cache");
+}
+
+bool MeshCache::open(const char * source, Layout layout) {
+
+    close();
+
+    struct stat src;
+    if (!statSource(source, src))
+        return false;
+
+    int fd = ::open(cachePath(source, layout).c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE,
+                   fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    const Header* h = static_cast<const Header*>(p);
+    bool valid = (memcmp(h->magic, cacheMagic, sizeof(cacheMagic)) == 0) &&
+                 (h->version == cacheVersion) &&
+                 (h->headerSize == sizeof(Header)) &&
+                 (h->fileSize == (uint64_t)st.st_size) &&
+                 (h->sourceSize == (uint64_t)src.st_size) &&
+                 (h->sourceMtimeSec == (int64_t)src.st_mtim.tv_sec) &&
+                 (h->sourceMtimeNsec == (int64_t)src.st_mtim.tv_nsec) &&
+                 (h->layout == (uint32_t)layout) &&
+                 (h->indexBase == (uint32_t)indexBase(layout));
+    // every array inside the file, and as many rest values as the layout
+    // has edges or faces
+    valid = valid &&
+        inside(h->verticesOffset, h->numVertices, 3*sizeof(double),
+               st.st_size) &&
+        inside(h->edgesOffset, h->numEdges, 2*sizeof(int32_t), st.st_size) &&
+        inside(h->edgeRestOffset, h->numEdgeRest, sizeof(double),
+               st.st_size) &&
+        inside(h->faceRestOffset, h->numFaceRest, sizeof(double),
+               st.st_size);
+    if (layout == Springs)
+        valid = valid && (h->numEdgeRest == h->numEdges) &&
+                (h->numFaceRest == 0);
+    else
+        valid = valid && (h->numEdges % 3 == 0) &&
+                (h->numFaceRest == h->numEdges / 3) && (h->numEdgeRest == 0);
+    if (!valid) {
+        munmap(p, st.st_size);
+        return false;
+    }
+
+    data = p;
+    length = st.st_size;
+    header = h;
+    this->layout = layout;
+    return true;
+}
+
+void MeshCache::close() {
+    if (data)
+        munmap(data, length);
+    data = NULL;
+    length = 0;
+    header = NULL;
+}
+
+bool MeshCache::read(simit::MeshVol& mesh, vector<double>& edgeRest,
+                     vector<double>& faceRest) const {
+
+    if (!header)
+        return false;
+    const char* base = static_cast<const char*>(data);
+
+    mesh.v.resize(header->numVertices);
+    memcpy(mesh.v.data(), base + header->verticesOffset,
+           header->numVertices * sizeof(mesh.v[0]));
+
+    mesh.edges.resize(header->numEdges);
+    memcpy(mesh.edges.data(), base + header->edgesOffset,
+           header->numEdges * sizeof(mesh.edges[0]));
+
+    edgeRest.assign((const double*)(base + header->edgeRestOffset),
+                    (const double*)(base + header->edgeRestOffset) +
+                    header->numEdgeRest);
+    faceRest.assign((const double*)(base + header->faceRestOffset),
+                    (const double*)(base + header->faceRestOffset) +
+                    header->numFaceRest);
+
+    int64_t first = indexBase(layout);
+    int64_t last = first + (int64_t)header->numVertices;
+    for (const std::array<int,2>& e : mesh.edges)
+        if ((e[0] < first) || (e[0] >= last) || (e[1] < first) ||
+            (e[1] >= last))
+            return false;
+    return true;
+}
+
+static bool writeBlock(FILE* fp, uint64_t offset, const void* src,
+                       size_t bytes) {
+    if (fseek(fp, offset, SEEK_SET) != 0)
+        return false;
+    return (bytes == 0) || (fwrite(src, 1, bytes, fp) == bytes);
+}
+
+bool MeshCache::write(const char * source, Layout layout,
+                      const simit::MeshVol& mesh,
+                      const vector<double>& edgeRest,
+                      const vector<double>& faceRest) {
+
+    static_assert(sizeof(mesh.v[0]) == 3*sizeof(double),
+                  "vertex layout must be three packed doubles");
+    static_assert(sizeof(mesh.edges[0]) == 2*sizeof(int32_t),
+                  "edge layout must be two packed int32");
+
+    struct stat src;
+    if (!statSource(source, src))
+        return false;
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, cacheMagic, sizeof(cacheMagic));
+    h.version         = cacheVersion;
+    h.headerSize      = sizeof(Header);
+    h.layout          = layout;
+    h.indexBase       = indexBase(layout);
+    h.sourceSize      = src.st_size;
+    h.sourceMtimeSec  = src.st_mtim.tv_sec;
+    h.sourceMtimeNsec = src.st_mtim.tv_nsec;
+    h.numVertices     = mesh.v.size();
+    h.numEdges        = mesh.edges.size();
+    h.numEdgeRest     = edgeRest.size();
+    h.numFaceRest     = faceRest.size();
+    h.verticesOffset  = alignUp(sizeof(Header));
+    h.edgesOffset     = alignUp(h.verticesOffset +
+                                h.numVertices * sizeof(mesh.v[0]));
+    h.edgeRestOffset  = alignUp(h.edgesOffset +
+                                h.numEdges * sizeof(mesh.edges[0]));
+    h.faceRestOffset  = alignUp(h.edgeRestOffset +
+                                h.numEdgeRest * sizeof(double));
+    h.fileSize        = h.faceRestOffset + h.numFaceRest * sizeof(double);
+
+    // Write to a temporary and rename so a concurrent reader never maps
+    // a half written cache.
+    string path = cachePath(source, layout);
+    string tmp = path + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp)
+        return false;
+
+    bool ok = writeBlock(fp, 0, &h, sizeof(h)) &&
+              writeBlock(fp, h.verticesOffset, mesh.v.data(),
+                         h.numVertices * sizeof(mesh.v[0])) &&
+              writeBlock(fp, h.edgesOffset, mesh.edges.data(),
+                         h.numEdges * sizeof(mesh.edges[0])) &&
+              writeBlock(fp, h.edgeRestOffset, edgeRest.data(),
+                         h.numEdgeRest * sizeof(double)) &&
+              writeBlock(fp, h.faceRestOffset, faceRest.data(),
+                         h.numFaceRest * sizeof(double));
+    // Extend the file to its full size in case the last array is empty.
+    ok = ok && (fflush(fp) == 0) && (ftruncate(fileno(fp), h.fileSize) == 0);
+    ok = (fclose(fp) == 0) && ok;
+
+    if (!ok || (rename(tmp.c_str(), path.c_str()) != 0)) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef _common_MeshCache_h
+#define _common_MeshCache_h
+
+#include "mesh.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Binary cache of a parsed and preprocessed OBJ mesh.
+ *
+ * The file is a fixed header followed by 64-byte aligned arrays:
+ *   vertices  : numVertices x 3 doubles
+ *   edges     : numEdges x 2 int32, exactly as produced by loadObject
+ *   edgeRest  : numEdgeRest doubles (rest lengths, may be empty)
+ *   faceRest  : numFaceRest doubles (rest areas, may be empty)
+ *
+ * The header records the byte size and modification time of the source
+ * .obj, so a cache whose source has changed is ignored and rewritten.
+ *
+ * Each driver preprocesses the mesh differently, so the layout is part of
+ * both the header and the file name, and a cache of another layout is
+ * never read.
+ *
+ * A cache only replaces parsing the text and the rest pass; the drivers
+ * still add every element to their sets one at a time. */
+class MeshCache
+{
+public:
+
+    enum Layout {
+        Springs = 1,	// 1-based edges, one rest length per edge
+        Triangles = 2	// 0-based edges, three per face, one rest area per face
+    };
+
+    MeshCache();
+    ~MeshCache();
+
+    // Maps the cache of the given layout belonging to source. Returns
+    // false if there is no cache or if it is stale, truncated, of another
+    // layout or from another format version.
+    bool open(const char * source, Layout layout);
+    void close();
+
+    // Copies the cached arrays out of the mapping. Returns false, leaving
+    // the outputs unspecified, if an edge refers to a missing vertex.
+    bool read(simit::MeshVol& mesh, std::vector<double>& edgeRest,
+              std::vector<double>& faceRest) const;
+
+    static bool write(const char * source, Layout layout,
+                      const simit::MeshVol& mesh,
+                      const std::vector<double>& edgeRest,
+                      const std::vector<double>& faceRest);
+
+    static std::string cachePath(const char * source, Layout layout);
+
+private:
+
+    struct Header;
+
+    void* data;
+    size_t length;
+    const Header* header;
+    Layout layout;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "MeshGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <stdlib.h>
+
+using namespace std;
+
+MeshGenerator::MeshGenerator(int base, int threads) : base(base),
+    pool(threads) {
+}
+
+bool MeshGenerator::isSpec(const string& name) {
+
+    return (name.compare(0, 5, "grid:") == 0) ||
+           (name.compare(0, 8, "lattice:") == 0);
+}
+
+bool MeshGenerator::generate(const string& spec, double step, int perFace,
+                             simit::MeshVol& mesh) {
+
+    bool isGrid = (spec.compare(0, 5, "grid:") == 0);
+    if (!isGrid && (spec.compare(0, 8, "lattice:") != 0))
+        return false;
+
+    // cell counts separated by 'x'
+    vector<long> n;
+    const char* s = spec.c_str() + (isGrid ? 5 : 8);
+    while (*s) {
+        char* end;
+        long value = strtol(s, &end, 10);
+        if ((end == s) || (value < 1) || (*end && (*end != 'x')) ||
+            ((*end == 'x') && !end[1]))
+            return false;
+        n.push_back(value);
+        s = *end ? end + 1 : end;
+    }
+    int dims = isGrid ? 2 : 3;
+    if (n.size() == 1) {
+        // a grid of n cells a side has 2n² triangles, a lattice about 6n³
+        double faces = (double)n[0] / max(perFace, 1);
+        long side = isGrid ? lround(sqrt(faces / 2.0))
+                           : lround(cbrt(faces / 6.0));
+        n.assign(dims, max(side, 1L));
+    }
+    if ((int)n.size() != dims)
+        return false;
+
+    if (isGrid)
+        grid((int)n[0], (int)n[1], step, mesh);
+    else
+        lattice((int)n[0], (int)n[1], (int)n[2], step, mesh);
+    return true;
+}
+
+void MeshGenerator::grid(int nx, int ny, double step, simit::MeshVol& mesh) {
+
+    size_t row = nx + 1;
+    mesh.v.resize(row * (ny + 1));
+    mesh.edges.resize(6 * (size_t)nx * ny);
+
+    auto vertices = [&](int, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            mesh.v[i] = {{(i % row) * step, (i / row) * step, 0.0}};
+    };
+    pool.run(mesh.v.size(), vertices);
+
+    // cell (i, j) is cut along its diagonal from (i, j) to (i+1, j+1)
+    auto cells = [&](int, size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            int p = (int)((c / nx) * row + c % nx) + base;
+            int q = p + 1;
+            int r = p + (int)row + 1;
+            int s = p + (int)row;
+            std::array<int,2>* e = &mesh.edges[6*c];
+            e[0] = {{p, q}}; e[1] = {{q, r}}; e[2] = {{r, p}};
+            e[3] = {{p, r}}; e[4] = {{r, s}}; e[5] = {{s, p}};
+        }
+    };
+    pool.run((size_t)nx * ny, cells);
+}
+
+void MeshGenerator::lattice(int nx, int ny, int nz, double step,
+                            simit::MeshVol& mesh) {
+
+    size_t row = nx + 1;
+    size_t layer = row * (ny + 1);
+    mesh.v.resize(layer * (nz + 1));
+
+    auto vertices = [&](int, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            mesh.v[i] = {{(i % row) * step, (i % layer / row) * step,
+                          (i / layer) * step}};
+    };
+    pool.run(mesh.v.size(), vertices);
+
+    // the squares normal to z, then to x, then to y; square s spans du
+    // and dv from its corner and is cut along du + dv
+    struct Family {
+        size_t count;
+        size_t cu, cv, cw;	// squares along u, v and w
+        int du, dv, dw;		// vertex strides along u, v and w
+    };
+    int sx = 1, sy = (int)row, sz = (int)layer;
+    Family families[3] = {
+        { (size_t)nx*ny*(nz+1), (size_t)nx, (size_t)ny, (size_t)nz+1,
+          sx, sy, sz },
+        { (size_t)ny*nz*(nx+1), (size_t)ny, (size_t)nz, (size_t)nx+1,
+          sy, sz, sx },
+        { (size_t)nz*nx*(ny+1), (size_t)nz, (size_t)nx, (size_t)ny+1,
+          sz, sx, sy },
+    };
+    size_t squares = families[0].count + families[1].count +
+                     families[2].count;
+    mesh.edges.resize(6 * squares);
+
+    auto faces = [&](int, size_t begin, size_t end) {
+        for (size_t q = begin; q < end; q++) {
+            size_t s = q;
+            int f = 0;
+            while (s >= families[f].count)
+                s -= families[f++].count;
+            const Family& F = families[f];
+            size_t u = s % F.cu, v = s / F.cu % F.cv, w = s / (F.cu*F.cv);
+            int a = (int)(u*F.du + v*F.dv + w*F.dw) + base;
+            int b = a + F.du;
+            int c = a + F.du + F.dv;
+            int d = a + F.dv;
+            std::array<int,2>* e = &mesh.edges[6*q];
+            e[0] = {{a, b}}; e[1] = {{b, c}}; e[2] = {{c, a}};
+            e[3] = {{a, c}}; e[4] = {{c, d}}; e[5] = {{d, a}};
+        }
+    };
+    pool.run(squares, faces);
+}
+
+void MeshGenerator::subdivide(int levels, simit::MeshVol& mesh) {
+
+    for (int level = 0; level < levels; level++)
+        refine(mesh);
+}
+
+void MeshGenerator::refine(simit::MeshVol& mesh) {
+
+    size_t nv = mesh.v.size();
+    size_t nf = mesh.edges.size() / 3;
+    auto corner = [&](size_t f, int i) {
+        return (uint64_t)(mesh.edges[3*f+i][0] - base);
+    };
+
+    // every edge once, as lower and higher vertex in one key
+    vector<uint64_t> keys(3*nf);
+    auto collect = [&](int, size_t begin, size_t end) {
+        for (size_t f = begin; f < end; f++)
+            for (int i = 0; i < 3; i++) {
+                uint64_t a = corner(f, i), b = corner(f, (i+1)%3);
+                keys[3*f+i] = (min(a, b) << 32) | max(a, b);
+            }
+    };
+    pool.run(nf, collect);
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+    // the midpoint of edge k becomes vertex nv + k
+    mesh.v.resize(nv + keys.size());
+    auto midpoints = [&](int, size_t begin, size_t end) {
+        for (size_t k = begin; k < end; k++) {
+            const std::array<double,3>& a = mesh.v[keys[k] >> 32];
+            const std::array<double,3>& b = mesh.v[keys[k] & 0xffffffff];
+            mesh.v[nv + k] = {{0.5*(a[0]+b[0]), 0.5*(a[1]+b[1]),
+                               0.5*(a[2]+b[2])}};
+        }
+    };
+    pool.run(keys.size(), midpoints);
+
+    // three corner triangles and the middle one, in the parent's winding
+    vector<std::array<int,2> > edges(12*nf);
+    auto split = [&](int, size_t begin, size_t end) {
+        for (size_t f = begin; f < end; f++) {
+            int c[3], m[3];
+            for (int i = 0; i < 3; i++) {
+                uint64_t a = corner(f, i), b = corner(f, (i+1)%3);
+                uint64_t key = (min(a, b) << 32) | max(a, b);
+                size_t k = lower_bound(keys.begin(), keys.end(), key) -
+                           keys.begin();
+                c[i] = (int)a + base;
+                m[i] = (int)(nv + k) + base;
+            }
+            int t[4][3] = { { c[0], m[0], m[2] }, { m[0], c[1], m[1] },
+                            { m[2], m[1], c[2] }, { m[0], m[1], m[2] } };
+            for (int j = 0; j < 4; j++)
+                for (int i = 0; i < 3; i++)
+                    edges[12*f + 3*j + i] = {{t[j][i], t[j][(i+1)%3]}};
+        }
+    };
+    pool.run(nf, split);
+    mesh.edges.swap(edges);
+}
+
+void MeshGenerator::restLengths(const simit::MeshVol& mesh,
+                                vector<double>& length) {
+
+    length.resize(mesh.edges.size());
+    auto lengths = [&](int, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const std::array<double,3>& a = mesh.v[mesh.edges[i][0] - base];
+            const std::array<double,3>& b = mesh.v[mesh.edges[i][1] - base];
+            length[i] = sqrt((a[0]-b[0])*(a[0]-b[0]) + (a[1]-b[1])*(a[1]-b[1]) +
+                             (a[2]-b[2])*(a[2]-b[2]));
+        }
+    };
+    pool.run(length.size(), lengths);
+}
+
+void MeshGenerator::restAreas(const simit::MeshVol& mesh,
+                              vector<double>& area) {
+
+    area.resize(mesh.edges.size() / 3);
+    auto areas = [&](int, size_t begin, size_t end) {
+        for (size_t f = begin; f < end; f++) {
+            const std::array<double,3>& a = mesh.v[mesh.edges[3*f][0] - base];
+            const std::array<double,3>& b = mesh.v[mesh.edges[3*f+1][0] - base];
+            const std::array<double,3>& c = mesh.v[mesh.edges[3*f+2][0] - base];
+            area[f] = 0.5 * fabs((b[0]-a[0])*(c[1]-a[1]) -
+                                 (c[0]-a[0])*(b[1]-a[1]));
+        }
+    };
+    pool.run(area.size(), areas);
+}
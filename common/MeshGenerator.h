@@ -0,0 +1,57 @@
+#ifndef _common_MeshGenerator_h
+#define _common_MeshGenerator_h
+
+#include "mesh.h"
+#include "WorkerPool.h"
+#include <string>
+#include <vector>
+
+/* Meshes built in memory for benchmarks past the size of data/: planar
+ * triangulated grids, 3D spring lattices and uniform refinement of a
+ * loaded mesh.
+ *
+ * The result goes straight into the simit::MeshVol the drivers fill their
+ * sets from, laid out as loadObject leaves it: three edges (a,b) (b,c)
+ * (c,a) per triangle, with vertex numbers starting at base (1 for
+ * SpringSystem, 0 for Elastic2D). Every vertex and triangle is a function
+ * of its index, so the workers of a WorkerPool write their own contiguous
+ * ranges. */
+class MeshGenerator
+{
+public:
+
+    explicit MeshGenerator(int base, int threads = 0);
+
+    // "grid:..." or "lattice:..." rather than a file name.
+    static bool isSpec(const std::string& name);
+
+    // Builds the mesh of a spec:
+    //   grid:NXxNY        NX x NY cells of two triangles in the z = 0 plane
+    //   lattice:NXxNYxNZ  every square of an NX x NY x NZ cubic lattice as
+    //                     two triangles, so all its faces are braced
+    //   grid:N, lattice:N about N elements, perFace of them per triangle
+    // with cells of edge step. False for a malformed spec.
+    bool generate(const std::string& spec, double step, int perFace,
+                  simit::MeshVol& mesh);
+
+    void grid(int nx, int ny, double step, simit::MeshVol& mesh);
+    void lattice(int nx, int ny, int nz, double step, simit::MeshVol& mesh);
+
+    // Splits every triangle into four at its edge midpoints, levels times;
+    // triangles sharing an edge share its midpoint.
+    void subdivide(int levels, simit::MeshVol& mesh);
+
+    // Per edge, and per triangle in the xy plane, as loadObject computes
+    // them.
+    void restLengths(const simit::MeshVol& mesh, std::vector<double>& length);
+    void restAreas(const simit::MeshVol& mesh, std::vector<double>& area);
+
+private:
+
+    void refine(simit::MeshVol& mesh);
+
+    int base;
+    WorkerPool pool;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "MessageLayer.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+// offsets in the segment, each array on its own cache line
+static size_t align(size_t bytes) {
+    return (bytes + 63) & ~(size_t)63;
+}
+
+SharedMemoryLayer::SharedMemoryLayer(int ranks, size_t points, int width) :
+    ranks(ranks), me(0), points(points), width(width), header(NULL),
+    scalars(NULL), step(0), creator(getpid()) {
+
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "/simit-halo-%d", (int)creator);
+    name = buffer;
+    bytes = align(sizeof(Header)) + align(ranks*sizeof(double)) +
+            2*align(points*width*sizeof(double));
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        perror("shm_open");
+        return;
+    }
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, bytes) == 0)
+        base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(name.c_str());
+        return;
+    }
+
+    header = static_cast<Header*>(base);
+    scalars = reinterpret_cast<double*>(static_cast<char*>(base) +
+                                        align(sizeof(Header)));
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(&header->barrier, &attr, ranks);
+    pthread_barrierattr_destroy(&attr);
+}
+
+SharedMemoryLayer::~SharedMemoryLayer() {
+
+    if (!header)
+        return;
+    // every forked rank unmaps, the creator also removes the name
+    if (getpid() == creator) {
+        pthread_barrier_destroy(&header->barrier);
+        shm_unlink(name.c_str());
+    }
+    munmap(header, bytes);
+}
+
+double* SharedMemoryLayer::slot(int parity) const {
+
+    char* base = reinterpret_cast<char*>(header) + align(sizeof(Header)) +
+                 align(ranks*sizeof(double));
+    return reinterpret_cast<double*>(base +
+                                     parity*align(points*width*sizeof(double)));
+}
+
+void SharedMemoryLayer::publish(const vector<int>& ids,
+                                const vector<double>& values) {
+
+    double* out = slot(step & 1);
+    for (size_t i = 0; i < ids.size(); i++)
+        copy(&values[i*width], &values[i*width] + width,
+             out + (size_t)ids[i]*width);
+}
+
+void SharedMemoryLayer::collect(const vector<int>& ids,
+                                vector<double>& values) {
+
+    barrier();
+    const double* in = slot(step & 1);
+    step++;
+    values.resize(ids.size()*width);
+    for (size_t i = 0; i < ids.size(); i++)
+        copy(in + (size_t)ids[i]*width, in + (size_t)ids[i]*width + width,
+             &values[i*width]);
+}
+
+void SharedMemoryLayer::gather(double value, vector<double>& all) {
+
+    scalars[me] = value;
+    barrier();
+    all.assign(scalars, scalars + ranks);
+    // nobody may overwrite its scalar before everyone has read
+    barrier();
+}
+
+double SharedMemoryLayer::sum(double value) {
+
+    vector<double> all;
+    gather(value, all);
+    double total = 0.0;
+    for (double v : all)
+        total += v;
+    return total;
+}
+
+double SharedMemoryLayer::max(double value) {
+
+    vector<double> all;
+    gather(value, all);
+    return *max_element(all.begin(), all.end());
+}
+
+void SharedMemoryLayer::barrier() {
+
+    pthread_barrier_wait(&header->barrier);
+}
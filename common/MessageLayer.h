@@ -0,0 +1,93 @@
+#ifndef _common_MessageLayer_h
+#define _common_MessageLayer_h
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/* Data exchange between the processes of a partitioned run.
+ *
+ * Every rank owns a subset of the global points and keeps copies (ghosts)
+ * of the points of other ranks next to its own. After a step, publish()
+ * makes the values of the owned points that others ghost visible and
+ * collect() reads the ghosts once every rank has published. Only these
+ * calls and the reductions are used by the drivers, so an MPI layer can
+ * replace the shared memory one with point-to-point sends of the same
+ * lists. */
+class MessageLayer
+{
+public:
+
+    virtual ~MessageLayer() {}
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    // values holds width doubles per listed global point.
+    virtual void publish(const std::vector<int>& ids,
+                         const std::vector<double>& values) = 0;
+    virtual void collect(const std::vector<int>& ids,
+                         std::vector<double>& values) = 0;
+
+    // Collective, every rank gets the sum or maximum over all ranks.
+    virtual double sum(double value) = 0;
+    virtual double max(double value) = 0;
+    virtual void barrier() = 0;
+};
+
+/* MessageLayer over one POSIX shared memory segment on one machine.
+ *
+ * The creating process maps the segment before forking the other ranks,
+ * which inherit the mapping; select() then tells each process its rank.
+ * Published values go to one of two slots by step parity, so a rank may
+ * publish the next step while a slower one is still collecting this one;
+ * the barrier in collect() keeps every rank within one step of the
+ * others. */
+class SharedMemoryLayer : public MessageLayer
+{
+public:
+
+    // Maps a segment for ranks processes exchanging width doubles for each
+    // of points global points.
+    SharedMemoryLayer(int ranks, size_t points, int width);
+    ~SharedMemoryLayer();
+
+    bool valid() const { return header != NULL; }
+    void select(int rank) { me = rank; }
+
+    int rank() const { return me; }
+    int size() const { return ranks; }
+    void publish(const std::vector<int>& ids,
+                 const std::vector<double>& values);
+    void collect(const std::vector<int>& ids, std::vector<double>& values);
+    double sum(double value);
+    double max(double value);
+    void barrier();
+
+private:
+
+    struct Header
+    {
+        pthread_barrier_t barrier;
+    };
+
+    double* slot(int parity) const;
+    void gather(double value, std::vector<double>& all);
+
+    SharedMemoryLayer(const SharedMemoryLayer&);
+    SharedMemoryLayer& operator=(const SharedMemoryLayer&);
+
+    std::string name;
+    int ranks;
+    int me;
+    size_t points;
+    int width;
+    size_t bytes;
+    Header* header;
+    double* scalars;	// one per rank, for the reductions
+    unsigned step;		// publish() calls so far, selects the slot
+    pid_t creator;
+};
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef _common_NativeEngine_h
+#define _common_NativeEngine_h
+
+#include <algorithm>
+#include <stddef.h>
+#include <vector>
+
+/* A hand-written engine for the explicit steps of SpringSystem.sim and
+ * Elastic2D.sim, to measure what the compiled procs leave on the table and
+ * to step meshes without simit.
+ *
+ * NativeEngine is templated on the scalar type, the dimension and the
+ * element, which fixes the arity. Points and elements are stored as
+ * structures of arrays, one std::vector per component, and the per
+ * element math works on fixed-size Mat values whose loops are unrolled at
+ * compile time. A step is the same three passes as main:
+ *
+ *   x += h v
+ *   f  = sum over the elements of their forces on their points
+ *   v += h m⁻¹ (f - c v + load)
+ *
+ * where m⁻¹ is zero for pinned points and load is the constant external
+ * force per point (m g for the springs, -g for the triangles). The drivers
+ * fill and read the engine in double through NativeStepper, whatever the
+ * scalar type. */
+
+// Calls f(0), ..., f(N-1), expanded by the compiler.
+template <int N>
+struct Unroll
+{
+    template <class F>
+    static void run(F f) {
+        Unroll<N-1>::run(f);
+        f(N-1);
+    }
+};
+
+template <>
+struct Unroll<0>
+{
+    template <class F>
+    static void run(F) {}
+};
+
+template <typename T, int R, int C = 1>
+struct Mat
+{
+    T a[R][C];
+
+    T& operator()(int i, int j = 0) { return a[i][j]; }
+    T operator()(int i, int j = 0) const { return a[i][j]; }
+
+    static Mat zero() {
+        Mat m;
+        Unroll<R>::run([&](int i) {
+            Unroll<C>::run([&](int j) { m.a[i][j] = T(0); });
+        });
+        return m;
+    }
+
+    static Mat identity() {
+        Mat m = zero();
+        Unroll<(R < C) ? R : C>::run([&](int i) { m.a[i][i] = T(1); });
+        return m;
+    }
+};
+
+template <typename T, int R, int K, int C>
+Mat<T,R,C> operator*(const Mat<T,R,K>& A, const Mat<T,K,C>& B) {
+    Mat<T,R,C> m;
+    Unroll<R>::run([&](int i) {
+        Unroll<C>::run([&](int j) {
+            T sum = T(0);
+            Unroll<K>::run([&](int k) { sum += A.a[i][k] * B.a[k][j]; });
+            m.a[i][j] = sum;
+        });
+    });
+    return m;
+}
+
+template <typename T, int R, int C>
+Mat<T,R,C> operator*(T s, const Mat<T,R,C>& A) {
+    Mat<T,R,C> m;
+    Unroll<R>::run([&](int i) {
+        Unroll<C>::run([&](int j) { m.a[i][j] = s * A.a[i][j]; });
+    });
+    return m;
+}
+
+template <typename T, int R, int C>
+Mat<T,R,C> operator+(const Mat<T,R,C>& A, const Mat<T,R,C>& B) {
+    Mat<T,R,C> m;
+    Unroll<R>::run([&](int i) {
+        Unroll<C>::run([&](int j) { m.a[i][j] = A.a[i][j] + B.a[i][j]; });
+    });
+    return m;
+}
+
+template <typename T, int R, int C>
+Mat<T,R,C> operator-(const Mat<T,R,C>& A, const Mat<T,R,C>& B) {
+    Mat<T,R,C> m;
+    Unroll<R>::run([&](int i) {
+        Unroll<C>::run([&](int j) { m.a[i][j] = A.a[i][j] - B.a[i][j]; });
+    });
+    return m;
+}
+
+template <typename T, int R, int C>
+Mat<T,C,R> transpose(const Mat<T,R,C>& A) {
+    Mat<T,C,R> m;
+    Unroll<R>::run([&](int i) {
+        Unroll<C>::run([&](int j) { m.a[j][i] = A.a[i][j]; });
+    });
+    return m;
+}
+
+template <typename T, int N>
+T trace(const Mat<T,N,N>& A) {
+    T sum = T(0);
+    Unroll<N>::run([&](int i) { sum += A.a[i][i]; });
+    return sum;
+}
+
+template <typename T, int N>
+T dot(const Mat<T,N>& a, const Mat<T,N>& b) {
+    T sum = T(0);
+    Unroll<N>::run([&](int i) { sum += a.a[i][0] * b.a[i][0]; });
+    return sum;
+}
+
+/* A spring of SpringSystem.sim: Green strain ε = (L² - L₀²)/(2 L₀²),
+ * energy ½kε² and the force -kε (x_a - x_b)/L₀ on its first point. The
+ * parameters are k and L₀. */
+template <typename T, int D>
+struct SpringElement
+{
+    static const int arity = 2;
+    static const int params = 2;
+
+    std::vector<T> k;
+    std::vector<T> L0;
+    std::vector<T> strain;		// written every step, as the field
+
+    void resize(size_t n) {
+        k.resize(n);
+        L0.resize(n);
+        strain.assign(n, T(0));
+    }
+
+    void set(size_t e, const double* p) {
+        k[e] = (T)p[0];
+        L0[e] = (T)p[1];
+    }
+
+    T energy(size_t e) const {
+        return T(0.5) * k[e] * strain[e] * strain[e];
+    }
+
+    void force(size_t e, const Mat<T,D> x[arity], Mat<T,D> f[arity]) {
+        Mat<T,D> L = x[0] - x[1];
+        T L02 = L0[e] * L0[e];
+        T s = (dot(L, L) - L02) / (T(2) * L02);
+        strain[e] = s;
+        f[0] = (-k[e] * s / L0[e]) * L;
+        f[1] = T(-1) * f[0];
+    }
+};
+
+/* A linear triangle of Elastic2D.sim's main: F = Ds Dm⁻¹ with Ds = [x₀-x₂,
+ * x₁-x₂], St. Venant-Kirchhoff energy A (α tr(ε²) + ½β tr(ε)²) of ε =
+ * (FᵀF - I)/2, and the forces -A F S Dm⁻ᵀ, S = 2αε + β tr(ε) I, on the
+ * first two points, the third taking minus their sum. The parameters are
+ * α, β, the rest area A and the rest edge matrix Dm, row major. */
+template <typename T, int D>
+struct TriangleElement
+{
+    static_assert(D == 2, "triangles are only stepped in the plane");
+    static const int arity = 3;
+    static const int params = 7;
+
+    std::vector<T> alpha;
+    std::vector<T> beta;
+    std::vector<T> area;
+    std::vector<T> DmInv[2][2];
+    std::vector<T> energies;	// written every step, as the field
+
+    void resize(size_t n) {
+        alpha.resize(n);
+        beta.resize(n);
+        area.resize(n);
+        for (int i = 0; i < 2; i++)
+            for (int j = 0; j < 2; j++)
+                DmInv[i][j].resize(n);
+        energies.assign(n, T(0));
+    }
+
+    void set(size_t e, const double* p) {
+        alpha[e] = (T)p[0];
+        beta[e] = (T)p[1];
+        area[e] = (T)p[2];
+        double det = p[3]*p[6] - p[4]*p[5];
+        DmInv[0][0][e] = (T)(p[6]/det);
+        DmInv[0][1][e] = (T)(-p[4]/det);
+        DmInv[1][0][e] = (T)(-p[5]/det);
+        DmInv[1][1][e] = (T)(p[3]/det);
+    }
+
+    T energy(size_t e) const { return energies[e]; }
+
+    void force(size_t e, const Mat<T,D> x[arity], Mat<T,D> f[arity]) {
+        typedef Mat<T,2,2> M2;
+        M2 Ds, Bm;
+        Unroll<2>::run([&](int i) {
+            Ds(i,0) = x[0](i) - x[2](i);
+            Ds(i,1) = x[1](i) - x[2](i);
+            Unroll<2>::run([&](int j) { Bm(i,j) = DmInv[i][j][e]; });
+        });
+        M2 F = Ds * Bm;
+        M2 strain = T(0.5) * (transpose(F) * F - M2::identity());
+        T tr = trace(strain);
+        energies[e] = area[e] * (alpha[e] * trace(strain * strain) +
+                                 T(0.5) * beta[e] * tr * tr);
+        M2 S = T(2) * alpha[e] * strain + (beta[e] * tr) * M2::identity();
+        M2 H = area[e] * (F * (S * transpose(Bm)));
+        Unroll<2>::run([&](int i) {
+            f[0](i) = -H(i,0);
+            f[1](i) = -H(i,1);
+            f[2](i) = H(i,0) + H(i,1);
+        });
+    }
+};
+
+// What the drivers see of a NativeEngine, in double.
+class NativeStepper
+{
+public:
+
+    virtual ~NativeStepper() {}
+
+    virtual void resize(size_t points, size_t elements) = 0;
+
+    // x, v and load are dims values; invMass is 0 for a pinned point.
+    virtual void setPoint(size_t i, const double* x, const double* v,
+                          double h, double invMass, double damping,
+                          const double* load) = 0;
+    // ends are arity point indices, params as the element documents.
+    virtual void setElement(size_t e, const int* ends,
+                            const double* params) = 0;
+    virtual void setState(size_t i, const double* x, const double* v) = 0;
+    virtual void getState(size_t i, double* x, double* v) const = 0;
+    virtual double elementEnergy(size_t e) const = 0;
+
+    virtual void step() = 0;
+};
+
+template <typename T, int D, template <typename, int> class Element>
+class NativeEngine : public NativeStepper
+{
+public:
+
+    typedef Element<T,D> Elements;
+    static const int arity = Elements::arity;
+
+    NativeEngine() : numPoints(0), numElements(0) {}
+
+    void resize(size_t points, size_t elements) {
+        numPoints = points;
+        numElements = elements;
+        for (int d = 0; d < D; d++) {
+            x[d].assign(points, T(0));
+            v[d].assign(points, T(0));
+            f[d].assign(points, T(0));
+            load[d].assign(points, T(0));
+        }
+        h.assign(points, T(0));
+        invMass.assign(points, T(0));
+        damping.assign(points, T(0));
+        for (int a = 0; a < arity; a++)
+            ends[a].assign(elements, 0);
+        elementData.resize(elements);
+    }
+
+    void setPoint(size_t i, const double* xi, const double* vi, double hi,
+                  double mi, double ci, const double* li) {
+        setState(i, xi, vi);
+        for (int d = 0; d < D; d++)
+            load[d][i] = (T)li[d];
+        h[i] = (T)hi;
+        invMass[i] = (T)mi;
+        damping[i] = (T)ci;
+    }
+
+    void setElement(size_t e, const int* points, const double* params) {
+        for (int a = 0; a < arity; a++)
+            ends[a][e] = points[a];
+        elementData.set(e, params);
+    }
+
+    void setState(size_t i, const double* xi, const double* vi) {
+        for (int d = 0; d < D; d++) {
+            x[d][i] = (T)xi[d];
+            v[d][i] = (T)vi[d];
+        }
+    }
+
+    void getState(size_t i, double* xi, double* vi) const {
+        for (int d = 0; d < D; d++) {
+            xi[d] = x[d][i];
+            vi[d] = v[d][i];
+        }
+    }
+
+    double elementEnergy(size_t e) const { return elementData.energy(e); }
+
+    void step() {
+        // each pass runs along contiguous component arrays
+        for (int d = 0; d < D; d++) {
+            T* xd = x[d].data();
+            const T* vd = v[d].data();
+            for (size_t i = 0; i < numPoints; i++)
+                xd[i] += h[i] * vd[i];
+            std::fill(f[d].begin(), f[d].end(), T(0));
+        }
+
+        Mat<T,D> xe[arity], fe[arity];
+        for (size_t e = 0; e < numElements; e++) {
+            Unroll<arity>::run([&](int a) {
+                int p = ends[a][e];
+                Unroll<D>::run([&](int d) { xe[a](d) = x[d][p]; });
+            });
+            elementData.force(e, xe, fe);
+            Unroll<arity>::run([&](int a) {
+                int p = ends[a][e];
+                Unroll<D>::run([&](int d) { f[d][p] += fe[a](d); });
+            });
+        }
+
+        for (int d = 0; d < D; d++) {
+            T* vd = v[d].data();
+            const T* fd = f[d].data();
+            const T* ld = load[d].data();
+            for (size_t i = 0; i < numPoints; i++)
+                vd[i] += h[i] * invMass[i] * (fd[i] - damping[i]*vd[i] + ld[i]);
+        }
+    }
+
+private:
+
+    size_t numPoints;
+    size_t numElements;
+    std::vector<T> x[D];
+    std::vector<T> v[D];
+    std::vector<T> f[D];
+    std::vector<T> load[D];
+    std::vector<T> h;
+    std::vector<T> invMass;
+    std::vector<T> damping;
+    std::vector<int> ends[arity];
+    Elements elementData;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "NumaTopology.h"
+#include <fstream>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+// "0-3,8-11" as written in sysfs cpulist files
+static vector<int> parseList(const string& list) {
+
+    vector<int> ids;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        int first, last;
+        int read = 0;
+        if (sscanf(list.c_str() + pos, "%d-%d%n", &first, &last, &read) != 2) {
+            if (sscanf(list.c_str() + pos, "%d%n", &first, &read) != 1)
+                break;
+            last = first;
+        }
+        for (int id = first; id <= last; id++)
+            ids.push_back(id);
+        pos += read;
+        if ((pos < list.size()) && (list[pos] == ','))
+            pos++;
+        else
+            break;
+    }
+    return ids;
+}
+
+NumaTopology::NumaTopology() {
+
+    // node numbers may have gaps, and nodes without cores cannot run a
+    // thread, so only the online nodes with cores are kept
+    ifstream online("/sys/devices/system/node/online");
+    string nodeList;
+    if (online && getline(online, nodeList))
+        for (int node : parseList(nodeList)) {
+            ifstream in("/sys/devices/system/node/node" + to_string(node) +
+                        "/cpulist");
+            string list;
+            if (!in || !getline(in, list))
+                continue;
+            vector<int> cores = parseList(list);
+            if (cores.empty())
+                continue;
+            cpus.push_back(cores);
+            ids.push_back(node);
+        }
+    if (cpus.empty()) {
+        cpus.push_back(vector<int>());
+        unsigned count = max(1u, thread::hardware_concurrency());
+        for (unsigned c = 0; c < count; c++)
+            cpus[0].push_back((int)c);
+        ids.assign(1, 0);
+    }
+}
+
+bool NumaTopology::pin(int node, int slot) const {
+
+#ifdef __linux__
+    const vector<int>& ids = cpus[node % cpus.size()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (slot >= 0)
+        CPU_SET(ids[slot % ids.size()], &set);
+    else
+        for (int id : ids)
+            CPU_SET(id, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+int NumaTopology::current() const {
+
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    for (size_t node = 0; node < cpus.size(); node++)
+        if (find(cpus[node].begin(), cpus[node].end(), cpu) !=
+            cpus[node].end())
+            return (int)node;
+#endif
+    return -1;
+}
+
+size_t NumaTopology::pagesOn(const void* begin, size_t bytes,
+                             int node) const {
+
+#if defined(__linux__) && defined(SYS_move_pages)
+    if ((bytes == 0) || (node < 0))
+        return 0;
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t first = reinterpret_cast<uintptr_t>(begin) & ~(page - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(begin) + bytes;
+    vector<void*> pages;
+    for (uintptr_t p = first; p < end; p += page)
+        pages.push_back(reinterpret_cast<void*>(p));
+    // without target nodes move_pages only reports where each page is
+    vector<int> status(pages.size(), -1);
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), NULL,
+                status.data(), 0) < 0)
+        return 0;
+    size_t resident = 0;
+    for (int s : status)
+        resident += (s == ids[node]);
+    return resident;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,46 @@
+#ifndef _common_NumaTopology_h
+#define _common_NumaTopology_h
+
+#include <stddef.h>
+#include <vector>
+
+/* The NUMA nodes of this machine that have cores, read from sysfs. A
+ * machine without NUMA information is one node holding every core. Nodes
+ * are indexed 0..nodes()-1 here; id() is the kernel's number of a node,
+ * which may have gaps or skip memory-only nodes.
+ *
+ * Pinning and page queries go straight to the kernel, so no libnuma is
+ * needed; both fail quietly where they are not supported. */
+class NumaTopology
+{
+public:
+
+    NumaTopology();
+
+    int nodes() const { return (int)cpus.size(); }
+    int id(int node) const { return ids[node]; }
+    const std::vector<int>& cores(int node) const { return cpus[node]; }
+
+    // The node that serves index i of n equal shares, e.g. worker i of n.
+    int nodeOf(size_t i, size_t n) const {
+        return (int)(i * cpus.size() / (n ? n : 1));
+    }
+
+    // Restricts the calling thread to the cores of node, or to the one
+    // core slot (modulo the node's cores) when slot is not negative.
+    bool pin(int node, int slot = -1) const;
+
+    // The node of the core the calling thread runs on, or -1.
+    int current() const;
+
+    // The number of pages overlapping [begin, begin + bytes) that live on
+    // node.
+    size_t pagesOn(const void* begin, size_t bytes, int node) const;
+
+private:
+
+    std::vector<std::vector<int> > cpus;	// cores per node
+    std::vector<int> ids;			// kernel node number per node
+};
+
+#endif
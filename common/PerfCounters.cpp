@@ -0,0 +1,135 @@
+#include "PerfCounters.h"
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+PerfCounters::PerfCounters() : numOpen(0) {
+
+    for (int e = 0; e < NumEvents; e++) {
+        fds[e] = -1;
+        slots[e] = -1;
+        totals[e] = 0.0;
+        base[e] = 0.0;
+    }
+    error = "not opened";
+}
+
+PerfCounters::~PerfCounters() {
+
+    for (int e = NumEvents-1; e >= 0; e--)
+        if (fds[e] >= 0)
+            close(fds[e]);
+}
+
+bool PerfCounters::open() {
+
+#ifdef __linux__
+    if (valid())
+        return true;
+    static const uint64_t configs[NumEvents] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (int e = 0; e < NumEvents; e++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[e];
+        attr.disabled = (e == Cycles);	// the leader starts the group
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1,
+                              (e == Cycles) ? -1 : fds[Cycles], 0);
+        if (fd < 0) {
+            // without a leader there is no group; missing members are fine
+            if (e == Cycles) {
+                error = string("perf_event_open: ") + strerror(errno);
+                if ((errno == EACCES) || (errno == EPERM))
+                    error += ", see /proc/sys/kernel/perf_event_paranoid";
+                return false;
+            }
+            continue;
+        }
+        fds[e] = fd;
+        slots[e] = numOpen++;
+    }
+    error.clear();
+    return true;
+#else
+    error = "no perf_event_open on this system";
+    return false;
+#endif
+}
+
+void PerfCounters::start() {
+
+#ifdef __linux__
+    if (!valid())
+        return;
+    ioctl(fds[Cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+void PerfCounters::stop() {
+
+#ifdef __linux__
+    if (!valid())
+        return;
+    ioctl(fds[Cycles], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    // nr, time enabled, time running, then one value per member; all of
+    // them run on since open(), so the estimate is of the whole total
+    uint64_t values[3 + NumEvents];
+    if (read(fds[Cycles], values, sizeof(values)) <
+        (ssize_t)((3 + numOpen)*sizeof(uint64_t)))
+        return;
+    double scale = (values[2] > 0) ? (double)values[1] / values[2] : 0.0;
+    for (int e = 0; e < NumEvents; e++)
+        if (slots[e] >= 0)
+            totals[e] = scale * values[3 + slots[e]];
+#endif
+}
+
+void PerfCounters::reset() {
+
+    for (int e = 0; e < NumEvents; e++)
+        base[e] = totals[e];
+}
+
+void PerfCounters::add(const PerfCounters& other) {
+
+    for (int e = 0; e < NumEvents; e++)
+        if (has((Event)e) && other.has((Event)e))
+            totals[e] += other.count((Event)e);
+}
+
+void PerfCounters::report(ostream& out, const string& name, double elements,
+                          const string& element, int steps) const {
+
+    out << "Counters " << name << ": ";
+    if (!valid()) {
+        out << "unavailable, " << error << endl;
+        return;
+    }
+    double perElement = (elements > 0.0) ? 1.0 / (elements * steps) : 0.0;
+    if (has(Instructions) && (count(Cycles) > 0.0))
+        out << count(Instructions) / count(Cycles) << " IPC, ";
+    out << count(Cycles) / steps << " cycles/step";
+    if (has(CacheMisses))
+        out << ", " << count(CacheMisses) * perElement << " LLC misses/"
+            << element;
+    if (has(BranchMisses))
+        out << ", " << count(BranchMisses) * perElement
+            << " branch misses/" << element;
+    out << endl;
+}
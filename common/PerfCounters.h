@@ -0,0 +1,62 @@
+#ifndef _common_PerfCounters_h
+#define _common_PerfCounters_h
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+
+/* Hardware counters of the calling thread, summed over start()/stop()
+ * pairs, e.g. around every run() of one simit Function.
+ *
+ * The events are opened as one perf_event_open group, so they count over
+ * the same intervals and their ratios stay meaningful when the kernel
+ * multiplexes the hardware counters; counts are scaled for the share of
+ * time the group was scheduled. Only user space is counted, which works
+ * with the default perf_event_paranoid setting. Events the machine lacks
+ * read as missing, and without counters at all (other systems, most
+ * containers) every call does nothing and report() says why. Threads
+ * other than the caller are not counted; open one set per thread and
+ * add() them up for a phase that runs on several. */
+class PerfCounters
+{
+public:
+
+    enum Event { Cycles, Instructions, CacheMisses, BranchMisses, NumEvents };
+
+    PerfCounters();
+    ~PerfCounters();
+
+    // Opens the counters, returns whether at least cycles are available.
+    bool open();
+    bool valid() const { return fds[Cycles] >= 0; }
+    bool has(Event e) const { return fds[e] >= 0; }
+
+    void start();
+    void stop();
+    void reset();	// count from here on
+
+    double count(Event e) const { return totals[e] - base[e]; }
+
+    // Adds other's counts since its reset() to these, until the next
+    // stop() reads this thread's counters again.
+    void add(const PerfCounters& other);
+
+    // "name: IPC, cycles per step, LLC and branch misses per element".
+    void report(std::ostream& out, const std::string& name,
+                double elements, const std::string& element,
+                int steps) const;
+
+private:
+
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    int fds[NumEvents];
+    int slots[NumEvents];	// position of each event in a group read
+    int numOpen;
+    double totals[NumEvents];	// since open(), as of the last stop()
+    double base[NumEvents];		// totals at the last reset()
+    std::string error;		// why the counters are unavailable
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "SimitSource.h"
+#include <fstream>
+
+using namespace std;
+
+static const int maxDepth = 8;	// of nested includes, against cycles
+
+bool SimitSource::read(const string& path, string& text) const {
+
+    text.clear();
+    return append(path, text, 0);
+}
+
+bool SimitSource::append(const string& path, string& text, int depth) const {
+
+    ifstream in(path.c_str());
+    if (!in || (depth > maxDepth))
+        return false;
+    string dir;
+    size_t slash = path.rfind('/');
+    if (slash != string::npos)
+        dir = path.substr(0, slash + 1);
+
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, 9, "%include ") == 0) {
+            string name = line.substr(9);
+            name.erase(name.find_last_not_of(" \t\r") + 1);
+            if (name.empty() ||
+                !append(name[0] == '/' ? name : dir + name, text, depth + 1))
+                return false;
+            continue;
+        }
+        if (line.compare(0, 2, "%[") == 0) {
+            size_t close = line.find(']');
+            if ((close != string::npos) &&
+                names.count(line.substr(2, close - 2)))
+                line = line.substr(close + 1);
+        }
+        text += line;
+        text += '\n';
+    }
+    return !in.bad();
+}
@@ -0,0 +1,34 @@
+#ifndef _common_SimitSource_h
+#define _common_SimitSource_h
+
+#include <set>
+#include <string>
+
+/* The text of a simit program, read on the host before Program::loadString.
+ *
+ * simit has no conditional compilation or includes, so one .sim file serves
+ * several variants of a program by tagging the lines that differ: a line
+ * that starts with %[name] keeps the text after the tag when name is
+ * defined, and otherwise stays a comment. A line %include FILE is replaced
+ * by the text of FILE, relative to the including file, so variants share
+ * their elements, funcs and procs; simit's diagnostics count lines of the
+ * expanded text. */
+class SimitSource
+{
+public:
+
+    // Keeps the lines tagged %[name] from now on.
+    void define(const std::string& name) { names.insert(name); }
+
+    // Reads path and the files it includes into text. Returns false if one
+    // of them cannot be read.
+    bool read(const std::string& path, std::string& text) const;
+
+private:
+
+    bool append(const std::string& path, std::string& text, int depth) const;
+
+    std::set<std::string> names;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "SleepTracker.h"
+#include <algorithm>
+
+using namespace std;
+
+SleepTracker::SleepTracker() : arity(0), dims(0), limit2(0.0), checks(1),
+    numActive(0) {
+}
+
+void SleepTracker::setElements(size_t points, int a, int d,
+                               const vector<int>& elementEnds) {
+
+    arity = a;
+    dims = d;
+    ends = elementEnds;
+    size_t numElements = arity ? ends.size()/arity : 0;
+
+    incidentStart.assign(points + 1, 0);
+    for (int p : ends)
+        incidentStart[p+1]++;
+    for (size_t p = 0; p < points; p++)
+        incidentStart[p+1] += incidentStart[p];
+    incident.resize(ends.size());
+    vector<int> cursor(incidentStart.begin(), incidentStart.end() - 1);
+    for (size_t i = 0; i < ends.size(); i++)
+        incident[cursor[ends[i]]++] = (int)(i/arity);
+
+    asleepNow.assign(points, 0);
+    awakeEnds.assign(numElements, (uint8_t)arity);
+    numActive = numElements;
+    awakeList.resize(points);
+    awakeSlot.resize(points);
+    for (size_t p = 0; p < points; p++)
+        awakeList[p] = awakeSlot[p] = p;
+    calm.assign(points, 0);
+    lastVelocity.assign(dims*points, 0.0);
+    pointMark.assign(points, 0);
+    elementMark.assign(numElements, 0);
+    binSteps.assign(11, 0);
+    binMs.assign(11, 0.0);
+    calmed.clear();
+    moving.clear();
+    woken.clear();
+}
+
+void SleepTracker::setLimits(double speed, int n) {
+
+    limit2 = speed*speed;
+    checks = max(n, 1);
+}
+
+void SleepTracker::observe(size_t p, const double* v) {
+
+    // a point is calm while both its speed and its change in velocity
+    // since the last check, which is its net force times the interval,
+    // stay under the sleep speed
+    double* last = &lastVelocity[dims*p];
+    double speed2 = 0.0, change2 = 0.0;
+    for (int d = 0; d < dims; d++) {
+        speed2 += v[d]*v[d];
+        change2 += (v[d] - last[d])*(v[d] - last[d]);
+        last[d] = v[d];
+    }
+    if ((speed2 >= limit2) || (change2 >= limit2)) {
+        calm[p] = 0;
+        if (speed2 >= limit2)
+            moving.push_back(p);
+    } else if (++calm[p] >= checks) {
+        calmed.push_back(p);
+    }
+}
+
+bool SleepTracker::settle() {
+
+    sleepers.clear();
+    wakers.clear();
+    for (size_t p : calmed)
+        if (!asleepNow[p]) {
+            fallAsleep(p);
+            sleepers.push_back(p);
+        }
+
+    // moving points wake the sleeping points they share an element with
+    for (size_t p : moving)
+        for (int i = incidentStart[p]; i < incidentStart[p+1]; i++) {
+            const int* e = &ends[arity*incident[i]];
+            for (int j = 0; j < arity; j++)
+                if (asleepNow[e[j]])
+                    woken.push_back(e[j]);
+        }
+    for (size_t p : woken)
+        if (asleepNow[p]) {
+            wakeUp(p);
+            wakers.push_back(p);
+        }
+
+    calmed.clear();
+    moving.clear();
+    woken.clear();
+    return !sleepers.empty() || !wakers.empty();
+}
+
+void SleepTracker::fallAsleep(size_t p) {
+
+    asleepNow[p] = 1;
+    size_t slot = awakeSlot[p];
+    awakeList[slot] = awakeList.back();
+    awakeSlot[awakeList[slot]] = slot;
+    awakeList.pop_back();
+    for (int i = incidentStart[p]; i < incidentStart[p+1]; i++)
+        if (--awakeEnds[incident[i]] == 0)
+            numActive--;
+}
+
+void SleepTracker::wakeUp(size_t p) {
+
+    asleepNow[p] = 0;
+    calm[p] = 0;
+    std::fill(&lastVelocity[dims*p], &lastVelocity[dims*p] + dims, 0.0);
+    awakeSlot[p] = awakeList.size();
+    awakeList.push_back(p);
+    for (int i = incidentStart[p]; i < incidentStart[p+1]; i++)
+        if (awakeEnds[incident[i]]++ == 0)
+            numActive++;
+}
+
+void SleepTracker::compact(vector<size_t>& points, vector<size_t>& elements) {
+
+    points.clear();
+    elements.clear();
+    for (size_t p : awakeList) {
+        if (!pointMark[p]) {
+            pointMark[p] = 1;
+            points.push_back(p);
+        }
+        for (int i = incidentStart[p]; i < incidentStart[p+1]; i++) {
+            int e = incident[i];
+            if (elementMark[e])
+                continue;
+            elementMark[e] = 1;
+            elements.push_back(e);
+            for (int j = 0; j < arity; j++) {
+                int q = ends[arity*e + j];
+                if (!pointMark[q]) {
+                    pointMark[q] = 1;
+                    points.push_back(q);
+                }
+            }
+        }
+    }
+    for (size_t p : points)
+        pointMark[p] = 0;
+    for (size_t e : elements)
+        elementMark[e] = 0;
+
+    // set order, so the blocks of each instance stay together
+    sort(points.begin(), points.end());
+    sort(elements.begin(), elements.end());
+}
+
+void SleepTracker::addStep(size_t active, double ms) {
+
+    size_t bin = elements() ? (10*active)/elements() : 10;
+    binSteps[bin]++;
+    binMs[bin] += ms;
+}
+
+void SleepTracker::reportSteps(ostream& out) const {
+
+    for (int bin = 10; bin >= 0; bin--) {
+        if (binSteps[bin] == 0)
+            continue;
+        out << "Active ";
+        if (bin == 10)
+            out << "100%";
+        else
+            out << 10*bin << "-" << 10*bin + 10 << "%";
+        out << " of the elements: " << binSteps[bin] << " steps, "
+            << binMs[bin]/binSteps[bin] << " ms/step" << endl;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef _common_SleepTracker_h
+#define _common_SleepTracker_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+
+/* Which points of a mesh are asleep, and the elements that still need
+ * their arithmetic.
+ *
+ * A check observes the velocity of every awake point and nothing else. A
+ * point that stayed calm, slower than the sleep speed and with a smaller
+ * change in velocity, for a number of checks in a row falls asleep; a
+ * point faster than that wakes the sleeping points that share an element
+ * with it, so a disturbance spreads one ring per check. The counts of
+ * awake points and of active elements, those with an awake point, follow
+ * every change, so a check costs the awake points and the elements around
+ * the points that changed.
+ *
+ * compact() lists the active elements and the points they touch, which
+ * are the awake points and a boundary of sleeping ones; the drivers step
+ * those in sets of their own and leave the rest untouched. */
+class SleepTracker
+{
+public:
+
+    SleepTracker();
+
+    // Elements of arity points each, ends[arity*e + i] the 0-based point i
+    // of element e; every point starts awake.
+    void setElements(size_t points, int arity, int dims,
+                     const std::vector<int>& ends);
+    void setLimits(double speed, int checks);
+
+    // The velocity of awake point p at this check, dims components.
+    void observe(size_t p, const double* v);
+    // Wakes sleeping point p at the next settle(), e.g. on a contact.
+    void wake(size_t p) { if (asleepNow[p]) woken.push_back(p); }
+    // Applies the observations and wake ups since the last settle().
+    // Returns true if a point fell asleep or woke.
+    bool settle();
+
+    // Points that fell asleep and woke in the last settle().
+    const std::vector<size_t>& fellAsleep() const { return sleepers; }
+    const std::vector<size_t>& woke() const { return wakers; }
+
+    const std::vector<size_t>& awake() const { return awakeList; }
+    bool asleep(size_t p) const { return asleepNow[p] != 0; }
+    size_t points() const { return asleepNow.size(); }
+    size_t elements() const { return awakeEnds.size(); }
+    size_t activeElements() const { return numActive; }
+
+    // The active elements and the points they touch, awake points without
+    // elements included, both in ascending order.
+    void compact(std::vector<size_t>& points,
+                 std::vector<size_t>& elements);
+
+    // Wall time of a step taken with active elements, binned by the active
+    // fraction in tenths, for the benches' ms/step against that fraction.
+    void addStep(size_t active, double ms);
+    void reportSteps(std::ostream& out) const;
+
+private:
+
+    void fallAsleep(size_t p);
+    void wakeUp(size_t p);
+
+    int arity;
+    int dims;
+    double limit2;				// sleep speed squared
+    int checks;
+    std::vector<int> ends;
+    std::vector<int> incidentStart;	// elements of point p are
+    std::vector<int> incident;		// incident[incidentStart[p]..[p+1])
+    std::vector<char> asleepNow;
+    std::vector<uint8_t> awakeEnds;	// awake points per element
+    size_t numActive;
+    std::vector<size_t> awakeList;
+    std::vector<size_t> awakeSlot;	// of each awake point in awakeList
+    std::vector<int> calm;			// consecutive calm checks per point
+    std::vector<double> lastVelocity;	// dims per point
+    std::vector<size_t> calmed;		// reached checks at this check
+    std::vector<size_t> moving;
+    std::vector<size_t> woken;
+    std::vector<size_t> sleepers;
+    std::vector<size_t> wakers;
+    std::vector<char> pointMark;	// scratch of compact()
+    std::vector<char> elementMark;
+    std::vector<int> binSteps;		// of addStep(), 11 tenths
+    std::vector<double> binMs;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "StateExport.h"
+#include <chrono>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace StateLayout;
+
+static size_t align(size_t bytes) {
+    return (bytes + 63) & ~(size_t)63;
+}
+
+static int64_t now() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static Slot* slotAt(const Header* header, uint64_t frame) {
+    char* base = (char*)header + header->slotsOffset;
+    return reinterpret_cast<Slot*>(base + (frame % header->slots) *
+                                          header->slotBytes);
+}
+
+StateExport::StateExport(const string& name, size_t points, int dims,
+                         const vector<int>& connectivity, int arity,
+                         int slots) :
+    name(name), bytes(0), header(NULL) {
+
+    size_t slotBytes = align(sizeof(Slot) + points*dims*sizeof(float));
+    size_t connectivityOffset = align(sizeof(Header));
+    size_t slotsOffset = connectivityOffset +
+                         align(connectivity.size()*sizeof(int));
+    bytes = slotsOffset + slots*slotBytes;
+
+    // a segment left behind by an earlier run is replaced
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return;
+    }
+    void* base = MAP_FAILED;
+    if (ftruncate(fd, bytes) == 0)
+        base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(name.c_str());
+        return;
+    }
+
+    header = static_cast<Header*>(base);
+    header->version = version;
+    header->points = (uint32_t)points;
+    header->dims = dims;
+    header->arity = arity;
+    header->elements = (uint32_t)(connectivity.size() / arity);
+    header->slots = slots;
+    header->slotBytes = slotBytes;
+    header->connectivityOffset = connectivityOffset;
+    header->slotsOffset = slotsOffset;
+    header->frames = 0;
+    header->writing = 1;
+    if (!connectivity.empty())
+        memcpy((char*)base + connectivityOffset, connectivity.data(),
+               connectivity.size()*sizeof(int));
+    // the ftruncate zeroed every sequence; readers check magic last
+    atomic_thread_fence(memory_order_release);
+    header->magic = magic;
+}
+
+StateExport::~StateExport() {
+
+    if (!header)
+        return;
+    header->writing = 0;
+    munmap(header, bytes);
+    shm_unlink(name.c_str());
+}
+
+void StateExport::publish(uint64_t step, double time, const float* positions) {
+
+    if (!header)
+        return;
+    uint64_t frame = header->frames.load(memory_order_relaxed);
+    Slot* slot = slotAt(header, frame);
+    uint64_t sequence = slot->sequence.load(memory_order_relaxed);
+    slot->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->frame = frame + 1;
+    slot->step = step;
+    slot->time = time;
+    slot->stamp = now();
+    memcpy(reinterpret_cast<float*>(slot + 1), positions,
+           header->points*header->dims*sizeof(float));
+
+    slot->sequence.store(sequence + 2, memory_order_release);
+    header->frames.store(frame + 1, memory_order_release);
+}
+
+StateView::StateView() : bytes(0), header(NULL) {
+}
+
+StateView::~StateView() {
+
+    detach();
+}
+
+bool StateView::attach(const string& name) {
+
+    detach();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void* base = MAP_FAILED;
+    if ((fstat(fd, &info) == 0) && ((size_t)info.st_size >= sizeof(Header)))
+        base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    bytes = info.st_size;
+    header = static_cast<const Header*>(base);
+    if ((header->magic != magic) || (header->version != version) ||
+        (header->slotsOffset + header->slots*header->slotBytes > bytes)) {
+        detach();
+        return false;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return true;
+}
+
+void StateView::detach() {
+
+    if (header)
+        munmap(const_cast<Header*>(header), bytes);
+    header = NULL;
+    bytes = 0;
+}
+
+const int* StateView::connectivity() const {
+
+    if (!header)
+        return NULL;
+    return reinterpret_cast<const int*>((const char*)header +
+                                        header->connectivityOffset);
+}
+
+bool StateView::read(StateFrame& frame, uint64_t last) const {
+
+    if (!header)
+        return false;
+    frame.positions.resize(header->points*header->dims);
+
+    // the newest slot, again from the then newest one whenever the
+    // writer got in the way
+    for (int attempt = 0; attempt < 8; attempt++) {
+        uint64_t frames = header->frames.load(memory_order_acquire);
+        if (frames <= last)
+            return false;
+        Slot* slot = slotAt(header, frames - 1);
+        uint64_t before = slot->sequence.load(memory_order_acquire);
+        if (before & 1)
+            continue;
+        frame.frame = slot->frame;
+        frame.step = slot->step;
+        frame.time = slot->time;
+        int64_t stamp = slot->stamp;
+        memcpy(frame.positions.data(), reinterpret_cast<float*>(slot + 1),
+               frame.positions.size()*sizeof(float));
+        atomic_thread_fence(memory_order_acquire);
+        if (slot->sequence.load(memory_order_relaxed) != before)
+            continue;
+        frame.age = (now() - stamp) * 1e-9;
+        return frame.frame > last;
+    }
+    return false;
+}
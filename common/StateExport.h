@@ -0,0 +1,120 @@
+#ifndef _common_StateExport_h
+#define _common_StateExport_h
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/* Live simulation state in a POSIX shared memory segment, for viewers
+ * and monitors running as separate processes.
+ *
+ * The segment holds a header, the connectivity (arity point indices per
+ * element, written once) and a ring of slots, each one frame of positions
+ * with its step, simulated time and wall clock stamp. Every slot is a
+ * seqlock: the writer makes its sequence odd, writes, and makes it even
+ * again, so it never waits for readers, and a reader that raced with the
+ * writer sees the sequence change and takes another slot. Readers only
+ * map the segment read-only and may come and go at any time. */
+namespace StateLayout {
+
+    const uint32_t magic = 0x53494d53;	// "SIMS"
+    const uint32_t version = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t points;
+        uint32_t dims;			// floats per point
+        uint32_t arity;			// points per element
+        uint32_t elements;
+        uint32_t slots;
+        uint32_t reserved;
+        uint64_t slotBytes;
+        uint64_t connectivityOffset;
+        uint64_t slotsOffset;
+        std::atomic<uint64_t> frames;	// published so far
+        std::atomic<uint32_t> writing;	// 0 once the writer is gone
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;	// odd while being written
+        uint64_t frame;
+        uint64_t step;
+        double time;			// simulated
+        int64_t stamp;			// steady clock, ns
+    };
+}
+
+class StateExport
+{
+public:
+
+    // Creates the segment name (e.g. "/springs") for points of dims
+    // floats, and writes the connectivity, arity indices per element.
+    StateExport(const std::string& name, size_t points, int dims,
+                const std::vector<int>& connectivity, int arity,
+                int slots = 4);
+    ~StateExport();
+
+    bool valid() const { return header != NULL; }
+
+    // Publishes one frame of points x dims positions.
+    void publish(uint64_t step, double time, const float* positions);
+
+private:
+
+    StateExport(const StateExport&);
+    StateExport& operator=(const StateExport&);
+
+    std::string name;
+    size_t bytes;
+    StateLayout::Header* header;
+};
+
+// One consistent frame as read by a StateView.
+struct StateFrame
+{
+    uint64_t frame;
+    uint64_t step;
+    double time;
+    double age;				// seconds since it was published
+    std::vector<float> positions;
+};
+
+class StateView
+{
+public:
+
+    StateView();
+    ~StateView();
+
+    // Maps an existing segment, false if there is none or it is foreign.
+    bool attach(const std::string& name);
+    void detach();
+
+    size_t points() const { return header ? header->points : 0; }
+    int dims() const { return header ? header->dims : 0; }
+    int arity() const { return header ? header->arity : 0; }
+    size_t elements() const { return header ? header->elements : 0; }
+    const int* connectivity() const;
+    bool writerAlive() const { return header && header->writing; }
+    uint64_t published() const { return header ? header->frames.load() : 0; }
+
+    // Reads the newest frame after last, false if there is none yet or
+    // the writer kept overwriting the slots being read.
+    bool read(StateFrame& frame, uint64_t last = 0) const;
+
+private:
+
+    StateView(const StateView&);
+    StateView& operator=(const StateView&);
+
+    size_t bytes;
+    const StateLayout::Header* header;
+};
+
+#endif
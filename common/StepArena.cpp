@@ -0,0 +1,263 @@
+#include "StepArena.h"
+#include <algorithm>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/DynamicLibrary.h"
+
+using namespace std;
+
+// every block starts with its size, which keeps blocks 16-byte aligned
+static const size_t header = 16;
+
+static size_t blockBytes(size_t bytes) {
+    return header + ((bytes + header-1) & ~(header-1));
+}
+static const int maxArenas = 16;
+static const size_t page = 4096;
+
+// The address space all buffers live in, maxArenas slots of slotBytes
+// each. It is reserved without backing at startup and committed
+// page by page as buffers grow; it is never unmapped, so blocks stay
+// valid after their arena is gone.
+static const int slotShift = sizeof(void*) >= 8 ? 32 : 0;
+static const size_t slotBytes = slotShift ? size_t(1) << slotShift : 0;
+static char* reserveRegion() {
+
+    if (!slotShift)
+        return NULL;
+    void* p = mmap(NULL, maxArenas*slotBytes, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? NULL : static_cast<char*>(p);
+}
+static char* const region = reserveRegion();
+
+// A destroyed arena with blocks still out keeps its slot taken, without
+// the arena.
+struct Slot
+{
+    atomic<bool> taken;
+    atomic<StepArena*> arena;
+};
+static Slot slots[maxArenas];
+static __thread StepArena* active = NULL;
+static atomic<bool> enabled(false);
+static atomic<size_t> heapCount(0);
+
+struct StepArenaHooks
+{
+    static int find(const void* p) {
+        uintptr_t offset = reinterpret_cast<uintptr_t>(p) -
+                           reinterpret_cast<uintptr_t>(region);
+        if (!region || (offset >= maxArenas*slotBytes))
+            return -1;
+        return (int)(offset >> slotShift);
+    }
+
+    static void* allocate(size_t bytes) {
+        return active ? active->allocate(bytes) : NULL;
+    }
+
+    static bool release(void* p) {
+        int i = find(p);
+        if (i < 0)
+            return false;
+        StepArena* arena = slots[i].arena.load();
+        if (arena) {
+            arena->liveBytes -= blockBytes(blockSize(p));
+            arena->live--;
+        }
+        return true;
+    }
+
+    static size_t blockSize(const void* p) {
+        return *reinterpret_cast<const size_t*>(
+                    static_cast<const char*>(p) - header);
+    }
+
+    // What the compiled procs call for malloc and its relatives.
+
+    static void* malloc(size_t bytes) {
+        void* p = allocate(bytes);
+        if (p)
+            return p;
+        heapCount++;
+        return ::malloc(bytes);
+    }
+
+    static void* calloc(size_t count, size_t bytes) {
+        if (active && (bytes == 0 || count <= (size_t)-1 / bytes)) {
+            void* p = allocate(count*bytes);
+            if (p) {
+                memset(p, 0, count*bytes);
+                return p;
+            }
+        }
+        heapCount++;
+        return ::calloc(count, bytes);
+    }
+
+    static void free(void* p) {
+        if (p && !release(p))
+            ::free(p);
+    }
+
+    static void* realloc(void* p, size_t bytes) {
+        if (!p)
+            return malloc(bytes);
+        if (find(p) < 0) {
+            heapCount++;
+            return ::realloc(p, bytes);
+        }
+        void* q = malloc(bytes);
+        if (q)
+            memcpy(q, p, min(bytes, blockSize(p)));
+        free(p);
+        return q;
+    }
+
+    // Aligned blocks always come from the heap.
+    static int posix_memalign(void** p, size_t alignment, size_t bytes) {
+        if ((alignment == 0) || (alignment & (alignment-1)) ||
+            (alignment % sizeof(void*)))
+            return EINVAL;
+        heapCount++;
+        return ::posix_memalign(p, alignment, bytes);
+    }
+
+    static void* aligned_alloc(size_t alignment, size_t bytes) {
+        void* p = NULL;
+        int error = posix_memalign(&p, alignment, bytes);
+        if (error)
+            errno = error;
+        return p;
+    }
+};
+
+StepArena::StepArena() :
+    slot(-1), buffer(NULL), size(0), used(0), scopeBytes(0), needed(0),
+    numServed(0), numOutlived(0), warned(false), live(0), liveBytes(0),
+    peakBytes(0) {
+
+    if (!region)
+        return;
+    for (int i = 0; (i < maxArenas) && (slot < 0); i++) {
+        bool open = false;
+        if (slots[i].taken.compare_exchange_strong(open, true))
+            slot = i;
+    }
+    if (slot < 0)
+        return;
+    slots[slot].arena = this;
+    buffer = region + slot*slotBytes;
+}
+
+StepArena::~StepArena() {
+
+    if (slot < 0)
+        return;
+    slots[slot].arena = NULL;
+    if (live > 0)
+        return;		// the blocks stay valid, the slot stays taken
+    // hand the pages back, the reservation stays
+    mmap(buffer, slotBytes, PROT_NONE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    slots[slot].taken = false;
+}
+
+void* StepArena::allocate(size_t bytes) {
+
+    size_t block = blockBytes(bytes);
+    scopeBytes += block;
+    if (used + block > size)
+        return NULL;
+    char* p = buffer + used;
+    used += block;
+    *reinterpret_cast<size_t*>(p) = bytes;
+    live++;
+    peakBytes = max(peakBytes, liveBytes += block);
+    numServed++;
+    return p + header;
+}
+
+void StepArena::fit() {
+
+    // the buffer does not move as it grows, so blocks still out stay
+    // where they are
+    if ((slot < 0) || (needed <= size))
+        return;
+    size_t grown = min((needed + page-1) & ~(page-1), slotBytes);
+    if (mprotect(buffer, grown, PROT_READ | PROT_WRITE) == 0)
+        size = grown;
+}
+
+void StepArena::begin() {
+
+    scopeBytes = 0;
+    // blocks still out keep the arena from starting over
+    if (live > 0)
+        return;
+    fit();
+    used = 0;
+}
+
+void StepArena::end() {
+
+    needed = max(needed, scopeBytes);
+    numOutlived = live;
+    if ((numOutlived > 0) && !warned) {
+        fprintf(stderr, "StepArena: %zu blocks outlived their scope, the "
+                "arena no longer starts over while they are out\n",
+                numOutlived);
+        warned = true;
+    }
+    fit();
+}
+
+void StepArena::enable(bool on) {
+
+    enabled = on;
+}
+
+StepArena::Scope::Scope(StepArena& arena) :
+    arena(arena), previous(active), engaged(enabled) {
+
+    if (!engaged)
+        return;
+    arena.begin();
+    active = &arena;
+}
+
+StepArena::Scope::~Scope() {
+
+    if (!engaged)
+        return;
+    active = previous;
+    arena.end();
+}
+
+void StepArena::hookCompiledProcs() {
+
+    // the JIT looks symbols added here up before the process's own
+    static atomic<bool> hooked(false);
+    if (hooked.exchange(true))
+        return;
+    using llvm::sys::DynamicLibrary;
+    DynamicLibrary::AddSymbol("malloc", (void*)&StepArenaHooks::malloc);
+    DynamicLibrary::AddSymbol("calloc", (void*)&StepArenaHooks::calloc);
+    DynamicLibrary::AddSymbol("realloc", (void*)&StepArenaHooks::realloc);
+    DynamicLibrary::AddSymbol("free", (void*)&StepArenaHooks::free);
+    DynamicLibrary::AddSymbol("posix_memalign",
+                              (void*)&StepArenaHooks::posix_memalign);
+    DynamicLibrary::AddSymbol("aligned_alloc",
+                              (void*)&StepArenaHooks::aligned_alloc);
+}
+
+size_t StepArena::heapAllocations() {
+
+    return heapCount;
+}
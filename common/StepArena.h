@@ -0,0 +1,96 @@
+#ifndef _common_StepArena_h
+#define _common_StepArena_h
+
+#include <atomic>
+#include <stddef.h>
+
+struct StepArenaHooks;
+
+/* Bump allocation for the temporaries of one simit Function.
+ *
+ * Only the JIT compiled procs allocate from arenas: hookCompiledProcs()
+ * binds the malloc family they call to the functions here, and the rest
+ * of the process keeps the C library's allocator. It has to run before
+ * program.compile(), which resolves the procs' external symbols.
+ *
+ * Scopes only take effect between enable(true) and enable(false), which
+ * the drivers' bench() brackets its steps with; otherwise every
+ * allocation of the procs goes straight to the heap. The first enabled
+ * scope only measures: its allocations go to the heap and their total
+ * sizes the arena. Later scopes bump through the arena, starting again at
+ * its beginning once everything from before was freed, so a run() in
+ * steady state does not touch the heap. A scope that does not fit falls
+ * back to the heap and the arena grows before the next one. Blocks still
+ * out when a scope ends keep the arena from starting over; they are
+ * counted in outlived() and reported once on stderr.
+ *
+ * Every arena's buffer lies in a slot of its own in one reserved range of
+ * address space, which it commits as it grows, so the procs' free() tells
+ * an arena block from a heap block with one comparison. Without the
+ * reservation, on 32-bit targets, scopes change nothing. */
+class StepArena
+{
+public:
+
+    StepArena();
+    ~StepArena();
+
+    class Scope
+    {
+    public:
+        explicit Scope(StepArena& arena);
+        ~Scope();
+    private:
+        Scope(const Scope&);
+        Scope& operator=(const Scope&);
+        StepArena& arena;
+        StepArena* previous;	// scopes nest per thread
+        bool engaged;		// arenas were enabled when it opened
+    };
+
+    // Scopes opened after enable(false) leave allocation to the heap.
+    static void enable(bool on);
+
+    // Bytes the buffer holds: everything one scope asked for, as bump
+    // allocation does not reuse blocks freed within a scope.
+    size_t capacity() const { return size; }
+    // Most bytes of blocks it served that were out at the same time.
+    size_t peak() const { return peakBytes; }
+    size_t served() const { return numServed; }
+    // Blocks that were still out when the last scope ended.
+    size_t outlived() const { return numOutlived; }
+
+    // Binds malloc, free and their relatives in the procs compiled from
+    // now on to the arenas; the first call does it, later ones nothing.
+    static void hookCompiledProcs();
+
+    // Allocations the compiled procs have made from the heap so far.
+    static size_t heapAllocations();
+
+private:
+
+    friend struct StepArenaHooks;
+
+    void* allocate(size_t bytes);
+    void begin();
+    void end();
+    void fit();			// commits the buffer up to needed
+
+    StepArena(const StepArena&);
+    StepArena& operator=(const StepArena&);
+
+    int slot;				// of the reserved range, -1 if none is free
+    char* buffer;
+    size_t size;
+    size_t used;			// bump offset
+    size_t scopeBytes;		// asked for by the open scope
+    size_t needed;			// most any scope asked for
+    size_t numServed;
+    size_t numOutlived;
+    bool warned;
+    std::atomic<size_t> live;	// blocks not freed yet, from any thread
+    std::atomic<size_t> liveBytes;
+    size_t peakBytes;
+};
+
+#endif
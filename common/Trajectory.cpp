@@ -0,0 +1,161 @@
+#include "Trajectory.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace TrajectoryLayout;
+
+static size_t align(size_t bytes) {
+    return (bytes + 63) & ~(size_t)63;
+}
+
+TrajectoryWriter::TrajectoryWriter(const string& path, size_t points,
+                                   int dims, const vector<int>& connectivity,
+                                   int arity) :
+    file(NULL), written(0) {
+
+    memset(&header, 0, sizeof(header));
+    header.magic = magic;
+    header.version = version;
+    header.points = (uint32_t)points;
+    header.dims = dims;
+    header.arity = arity;
+    header.elements = (uint32_t)(connectivity.size() / arity);
+    header.frameBytes = align(sizeof(Frame) + points*dims*sizeof(float));
+    header.connectivityOffset = align(sizeof(Header));
+    header.framesOffset = header.connectivityOffset +
+                          align(connectivity.size()*sizeof(int));
+
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        perror(path.c_str());
+        return;
+    }
+    vector<char> head(header.framesOffset, 0);
+    memcpy(head.data(), &header, sizeof(header));
+    if (!connectivity.empty())
+        memcpy(&head[header.connectivityOffset], connectivity.data(),
+               connectivity.size()*sizeof(int));
+    if (fwrite(head.data(), 1, head.size(), file) != head.size()) {
+        perror(path.c_str());
+        fclose(file);
+        file = NULL;
+        return;
+    }
+    frame.assign(header.frameBytes, 0);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+
+    if (file)
+        fclose(file);
+}
+
+void TrajectoryWriter::write(uint64_t step, double time,
+                             const float* positions) {
+
+    if (!file)
+        return;
+    Frame* f = reinterpret_cast<Frame*>(frame.data());
+    f->step = step;
+    f->time = time;
+    memcpy(reinterpret_cast<float*>(f + 1), positions,
+           header.points*header.dims*sizeof(float));
+    if (fwrite(frame.data(), 1, frame.size(), file) != frame.size()) {
+        perror("trajectory");
+        fclose(file);
+        file = NULL;
+        return;
+    }
+    written++;
+}
+
+TrajectoryReader::TrajectoryReader() : bytes(0), header(NULL), count(0) {
+}
+
+TrajectoryReader::~TrajectoryReader() {
+
+    close();
+}
+
+bool TrajectoryReader::open(const string& path) {
+
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void* base = MAP_FAILED;
+    if ((fstat(fd, &info) == 0) && ((size_t)info.st_size >= sizeof(Header)))
+        base = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    bytes = info.st_size;
+    header = static_cast<const Header*>(base);
+    // the connectivity must fit between the header and the frames, and a
+    // frame must hold its step, time and every position
+    uint64_t indices = (uint64_t)header->elements * header->arity;
+    uint64_t floats = (uint64_t)header->points * header->dims;
+    bool valid = (header->magic == magic) && (header->version == version) &&
+        (header->framesOffset <= bytes) &&
+        (header->connectivityOffset >= sizeof(Header)) &&
+        (header->connectivityOffset % sizeof(int) == 0) &&
+        (header->connectivityOffset <= header->framesOffset) &&
+        (indices <= (header->framesOffset - header->connectivityOffset) /
+                    sizeof(int)) &&
+        (header->framesOffset % alignof(Frame) == 0) &&
+        (header->frameBytes % alignof(Frame) == 0) &&
+        (floats <= (uint64_t)-1 / sizeof(float) - sizeof(Frame)) &&
+        (header->frameBytes >= sizeof(Frame) + floats*sizeof(float));
+    if (!valid) {
+        close();
+        return false;
+    }
+    // a partly written last frame is left out
+    count = (bytes - header->framesOffset) / header->frameBytes;
+    return true;
+}
+
+void TrajectoryReader::close() {
+
+    if (header)
+        munmap(const_cast<Header*>(header), bytes);
+    header = NULL;
+    bytes = 0;
+    count = 0;
+}
+
+const int* TrajectoryReader::connectivity() const {
+
+    if (!header)
+        return NULL;
+    return reinterpret_cast<const int*>((const char*)header +
+                                        header->connectivityOffset);
+}
+
+const Frame* TrajectoryReader::frameAt(size_t frame) const {
+
+    return reinterpret_cast<const Frame*>((const char*)header +
+                                          header->framesOffset +
+                                          frame*header->frameBytes);
+}
+
+uint64_t TrajectoryReader::step(size_t frame) const {
+
+    return frameAt(frame)->step;
+}
+
+double TrajectoryReader::time(size_t frame) const {
+
+    return frameAt(frame)->time;
+}
+
+const float* TrajectoryReader::positions(size_t frame) const {
+
+    return reinterpret_cast<const float*>(frameAt(frame) + 1);
+}
@@ -0,0 +1,105 @@
+#ifndef _common_Trajectory_h
+#define _common_Trajectory_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/* Position frames of a run saved to a file, for rendering and analysis
+ * after the fact.
+ *
+ * The file is a header, the connectivity (arity point indices per
+ * element) and then one frame after the other, each its step, simulated
+ * time and points x dims floats, all 64-byte aligned. The number of
+ * frames follows from the file size, so the frames of a run that was
+ * stopped early can still be read. */
+namespace TrajectoryLayout {
+
+    const uint32_t magic = 0x544d4953;	// "SIMT"
+    const uint32_t version = 1;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t points;
+        uint32_t dims;			// floats per point
+        uint32_t arity;			// points per element
+        uint32_t elements;
+        uint64_t frameBytes;
+        uint64_t connectivityOffset;
+        uint64_t framesOffset;
+    };
+
+    struct Frame
+    {
+        uint64_t step;
+        double time;			// simulated
+    };
+}
+
+class TrajectoryWriter
+{
+public:
+
+    // Creates path for points of dims floats and writes the
+    // connectivity, arity indices per element.
+    TrajectoryWriter(const std::string& path, size_t points, int dims,
+                     const std::vector<int>& connectivity, int arity);
+    ~TrajectoryWriter();
+
+    bool valid() const { return file != NULL; }
+    uint64_t frames() const { return written; }
+
+    // Appends one frame of points x dims positions.
+    void write(uint64_t step, double time, const float* positions);
+
+private:
+
+    TrajectoryWriter(const TrajectoryWriter&);
+    TrajectoryWriter& operator=(const TrajectoryWriter&);
+
+    FILE* file;
+    TrajectoryLayout::Header header;
+    std::vector<char> frame;	// one padded frame, reused
+    uint64_t written;
+};
+
+class TrajectoryReader
+{
+public:
+
+    TrajectoryReader();
+    ~TrajectoryReader();
+
+    // Maps a trajectory file, false if it is missing, foreign or its
+    // header does not describe a layout that fits the file.
+    bool open(const std::string& path);
+    void close();
+
+    size_t points() const { return header ? header->points : 0; }
+    int dims() const { return header ? header->dims : 0; }
+    int arity() const { return header ? header->arity : 0; }
+    size_t elements() const { return header ? header->elements : 0; }
+    const int* connectivity() const;
+    size_t frames() const { return count; }
+
+    uint64_t step(size_t frame) const;
+    double time(size_t frame) const;
+    const float* positions(size_t frame) const;
+
+private:
+
+    TrajectoryReader(const TrajectoryReader&);
+    TrajectoryReader& operator=(const TrajectoryReader&);
+
+    const TrajectoryLayout::Frame* frameAt(size_t frame) const;
+
+    size_t bytes;
+    const TrajectoryLayout::Header* header;
+    size_t count;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "WorkerPool.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(int threads) : generation(0), pending(0),
+    stopping(false), task(NULL), context(NULL), count(0) {
+
+    numWorkers = (threads > 0) ? threads : (int)thread::hardware_concurrency();
+    if (numWorkers < 1)
+        numWorkers = 1;
+    for (int w = 1; w < numWorkers; w++)
+        this->threads.push_back(thread(&WorkerPool::work, this, w));
+}
+
+WorkerPool::~WorkerPool() {
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (thread& t : threads)
+        t.join();
+}
+
+void WorkerPool::pin(const NumaTopology& numa) {
+
+    // one index per worker, run on the worker itself; worker 0 is the
+    // calling thread, which also runs everything outside the pool, so it
+    // keeps its affinity
+    auto pinSelf = [&](int worker, size_t, size_t) {
+        if (worker == 0)
+            return;
+        int node = numa.nodeOf(worker, numWorkers);
+        int first = 0;
+        while ((first < worker) && (numa.nodeOf(first, numWorkers) != node))
+            first++;
+        numa.pin(node, worker - first);
+    };
+    run(numWorkers, pinSelf);
+}
+
+void WorkerPool::share(int worker, size_t& begin, size_t& end) const {
+
+    begin = count * worker / numWorkers;
+    end = count * (worker + 1) / numWorkers;
+}
+
+void WorkerPool::dispatch(size_t n, Task t, void* f) {
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+        task = t;
+        context = f;
+        count = n;
+        pending = numWorkers - 1;
+        generation++;
+    }
+    started.notify_all();
+
+    size_t begin, end;
+    share(0, begin, end);
+    if (begin < end)
+        t(f, 0, begin, end);
+
+    unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return pending == 0; });
+}
+
+void WorkerPool::work(int worker) {
+
+    unsigned seen = 0;
+    for (;;) {
+        {
+            unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [&]() {
+                return stopping || (generation != seen);
+            });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        size_t begin, end;
+        share(worker, begin, end);
+        if (begin < end)
+            task(context, worker, begin, end);
+
+        bool last;
+        {
+            lock_guard<std::mutex> lock(mutex);
+            last = (--pending == 0);
+        }
+        if (last)
+            finished.notify_one();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef _common_WorkerPool_h
+#define _common_WorkerPool_h
+
+#include "NumaTopology.h"
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+/* A fixed set of threads that split index ranges between them.
+ *
+ * run(n, f) calls f(worker, begin, end) once per worker on a contiguous
+ * share of [0, n) and returns when all of them are done. The calling
+ * thread is worker 0. Nothing is allocated per run, so per-step stages can
+ * use it without touching the heap. */
+class WorkerPool
+{
+public:
+
+    // 0 threads means one per hardware thread.
+    explicit WorkerPool(int threads = 0);
+    ~WorkerPool();
+
+    int size() const { return numWorkers; }
+
+    // Pins worker w > 0 to a core of node numa.nodeOf(w, size()), so each
+    // share of a run stays on one node. The calling thread is not pinned.
+    void pin(const NumaTopology& numa);
+
+    template <typename F>
+    void run(size_t n, F& f) {
+        dispatch(n, &invoke<F>, &f);
+    }
+
+private:
+
+    typedef void (*Task)(void* f, int worker, size_t begin, size_t end);
+
+    template <typename F>
+    static void invoke(void* f, int worker, size_t begin, size_t end) {
+        (*static_cast<F*>(f))(worker, begin, end);
+    }
+
+    void dispatch(size_t n, Task task, void* f);
+    void work(int worker);
+    void share(int worker, size_t& begin, size_t& end) const;
+
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    int numWorkers;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    unsigned generation;	// bumped once per run()
+    int pending;			// workers still busy with this generation
+    bool stopping;
+    Task task;
+    void* context;
+    size_t count;
+};
+
+#endif